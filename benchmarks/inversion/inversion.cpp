@@ -0,0 +1,153 @@
+// inversion.cpp
+// This benchmark measures how long a high priority task waits for a lock that a low priority task
+// holds during a delay(), while background tasks of medium priority keep yielding. The lock is either
+// a binary CoopSemaphore, which has no owner, such that the low priority task starves behind the
+// background tasks until their load ends, or a CoopMutex, whose owner inherits the priority of the
+// waiting task and releases the lock as soon as its delay is over.
+// All tasks run in ready queue mode, which schedules by priority.
+// Results are written to stdout as one JSON object per line, like those of microbench, for instance:
+// {"benchmark":"priority_inversion","lock":"CoopMutex","background":4,"ops":20,"avg_us":3001.0,"worst_us":3035.4}
+// Build on Linux, for instance: g++ -std=c++17 -O2 -I../../src inversion.cpp ../../src/*.cpp -o inversion
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include "CoopTask.h"
+#include "CoopSemaphore.h"
+#include "CoopMutex.h"
+
+namespace
+{
+    constexpr size_t TASKSTACKSIZE = 0x1000;
+    constexpr unsigned ROUNDS = 20;
+    // the low priority task holds the lock for HOLDMS, the high priority task asks for it about 2 ms later
+    constexpr uint32_t HOLDMS = 5;
+    // the background tasks stay ready for LOADMS after the high priority task asks for the lock
+    constexpr uint32_t LOADMS = 20;
+    constexpr uint8_t LOWPRIORITY = 0;
+    constexpr uint8_t BACKGROUNDPRIORITY = 1;
+    constexpr uint8_t HIGHPRIORITY = 2;
+
+    using Clock = std::chrono::steady_clock;
+
+    class SemaphoreLock
+    {
+    public:
+        static const char* name() { return "CoopSemaphore"; }
+        bool lock() { return sem.wait(); }
+        bool unlock() { return sem.post(); }
+
+    protected:
+        CoopSemaphore sem{ 1 };
+    };
+
+    class MutexLock
+    {
+    public:
+        static const char* name() { return "CoopMutex"; }
+        bool lock() { return mutex.lock(); }
+        bool unlock() { return mutex.unlock(); }
+
+    protected:
+        CoopMutex mutex;
+    };
+
+    void runUntilExited(size_t tasksCount)
+    {
+        size_t exited = 0;
+        const auto reaper = [&exited](const CoopTaskBase* const task)
+        {
+            ++exited;
+            delete task;
+        };
+        while (exited < tasksCount)
+        {
+            runCoopTasks(reaper);
+        }
+    }
+
+    template<typename Lock>
+    bool measure(size_t backgroundCount)
+    {
+        Lock lock;
+        CoopSemaphore lowRound(0);
+        CoopSemaphore load(0);
+        Clock::time_point loadUntil;
+        bool quit = false;
+        bool held = false;
+        double totalUs = 0;
+        double worstUs = 0;
+
+        auto low = createCoopTask<void>(std::string("low"), [&]() noexcept
+            {
+                for (;;)
+                {
+                    lowRound.wait();
+                    if (quit) break;
+                    lock.lock();
+                    held = true;
+                    delay(HOLDMS);
+                    held = false;
+                    lock.unlock();
+                }
+            }, TASKSTACKSIZE);
+        if (!low) return false;
+        low->setPriority(LOWPRIORITY);
+
+        for (size_t i = 0; i < backgroundCount; ++i)
+        {
+            auto task = createCoopTask<void>(std::string("background"), [&]() noexcept
+                {
+                    for (;;)
+                    {
+                        load.wait();
+                        if (quit) break;
+                        while (Clock::now() < loadUntil) yield();
+                    }
+                }, TASKSTACKSIZE);
+            if (!task) return false;
+            task->setPriority(BACKGROUNDPRIORITY);
+        }
+
+        auto high = createCoopTask<void>(std::string("high"), [&]() noexcept
+            {
+                for (unsigned round = 0; round < ROUNDS; ++round)
+                {
+                    // let the low priority task take the lock before the load starts
+                    lowRound.post();
+                    while (!held) delay(1);
+                    delay(1);
+                    loadUntil = Clock::now() + std::chrono::milliseconds(LOADMS);
+                    load.post(static_cast<unsigned>(backgroundCount));
+                    const auto start = Clock::now();
+                    lock.lock();
+                    const double us = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1000.0;
+                    lock.unlock();
+                    totalUs += us;
+                    worstUs = std::max(worstUs, us);
+                    // rounds start without load
+                    while (Clock::now() < loadUntil) delay(1);
+                }
+                quit = true;
+                lowRound.post();
+                load.post(static_cast<unsigned>(backgroundCount));
+            }, TASKSTACKSIZE);
+        if (!high) return false;
+        high->setPriority(HIGHPRIORITY);
+
+        runUntilExited(backgroundCount + 2);
+        std::cout << "{\"benchmark\":\"priority_inversion\",\"lock\":\"" << Lock::name() << "\",\"background\":" << backgroundCount
+            << ",\"ops\":" << ROUNDS << ",\"avg_us\":" << totalUs / ROUNDS << ",\"worst_us\":" << worstUs << '}' << std::endl;
+        return true;
+    }
+}
+
+int main()
+{
+    CoopTaskBase::useReadyQueue();
+    for (size_t backgroundCount : { 1, 4, 16 })
+    {
+        if (!measure<SemaphoreLock>(backgroundCount) || !measure<MutexLock>(backgroundCount)) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+// latency.cpp
+// This benchmark measures the wake-up latency of a control loop task with a period of 1 ms,
+// while 1 to 64 background tasks each keep the CPU busy for BUSYUS between yields.
+// It compares the scheduling policies of ready queue mode: round-robin, that is, the default
+// CoopFixedPriorityPolicy with equal priorities, the same with a higher priority for the control
+// loop, and CoopWeightedFairPolicy with a higher weight for the control loop.
+// The latency is the time from the deadline of the control loop's delay() until it runs.
+// Results are written to stdout as one JSON object per line, like those of microbench, for instance:
+// {"benchmark":"control_latency","policy":"weighted_fair","background":16,"ops":500,"p50_us":8.84,"p99_us":31.93,"worst_us":1245.46,"control_share":0.0021}
+// Build on Linux, for instance: g++ -std=c++17 -O2 -I../../src latency.cpp ../../src/*.cpp -o latency
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "CoopTask.h"
+
+namespace
+{
+    constexpr size_t TASKSTACKSIZE = 0x1000;
+    constexpr size_t PERIODS = 500;
+    constexpr uint32_t PERIODMS = 1;
+    constexpr uint32_t BUSYUS = 20;
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class Policy { RoundRobin, FixedPriority, WeightedFair };
+
+    const char* policyName(Policy policy)
+    {
+        switch (policy)
+        {
+        case Policy::FixedPriority: return "fixed_priority";
+        case Policy::WeightedFair: return "weighted_fair";
+        default: return "round_robin";
+        }
+    }
+
+    double percentile(std::vector<double>& samples, double p)
+    {
+        std::sort(samples.begin(), samples.end());
+        return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+    }
+
+    bool measure(Policy policy, size_t backgroundCount)
+    {
+        CoopWeightedFairPolicy weightedFair;
+        CoopTaskBase::useSchedulingPolicy(policy == Policy::WeightedFair ? &weightedFair : nullptr);
+        std::vector<double> latencies;
+        latencies.reserve(PERIODS);
+        bool quit = false;
+        Clock::duration controlTime{};
+        Clock::duration backgroundTime{};
+
+        for (size_t i = 0; i < backgroundCount; ++i)
+        {
+            auto task = createCoopTask<void>(std::string("background"), [&]() noexcept
+                {
+                    while (!quit)
+                    {
+                        const auto start = Clock::now();
+                        while (Clock::now() - start < std::chrono::microseconds(BUSYUS)) {}
+                        backgroundTime += Clock::now() - start;
+                        yield();
+                    }
+                }, TASKSTACKSIZE);
+            if (!task) return false;
+        }
+
+        auto control = createCoopTask<void>(std::string("control"), [&]() noexcept
+            {
+                for (size_t i = 0; i < PERIODS; ++i)
+                {
+                    const auto deadline = Clock::now() + std::chrono::milliseconds(PERIODMS);
+                    delay(PERIODMS);
+                    const auto woke = Clock::now();
+                    latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(woke - deadline).count() / 1000.0);
+                    // a short control step
+                    while (Clock::now() - woke < std::chrono::microseconds(2)) {}
+                    controlTime += Clock::now() - woke;
+                }
+                quit = true;
+            }, TASKSTACKSIZE);
+        if (!control) return false;
+        if (policy == Policy::FixedPriority) control->setPriority(1);
+        if (policy == Policy::WeightedFair) control->setWeight(64);
+
+        size_t exited = 0;
+        while (exited < backgroundCount + 1)
+        {
+            runCoopTasks([&exited](const CoopTaskBase* const task)
+                {
+                    ++exited;
+                    delete task;
+                });
+        }
+        CoopTaskBase::useSchedulingPolicy(nullptr);
+
+        const double share = std::chrono::duration<double>(controlTime).count() /
+            std::chrono::duration<double>(controlTime + backgroundTime).count();
+        std::cout << "{\"benchmark\":\"control_latency\",\"policy\":\"" << policyName(policy) << "\",\"background\":" << backgroundCount
+            << ",\"ops\":" << latencies.size() << ",\"p50_us\":" << percentile(latencies, 0.5) << ",\"p99_us\":" << percentile(latencies, 0.99)
+            << ",\"worst_us\":" << latencies.back() << ",\"control_share\":" << share << '}' << std::endl;
+        return true;
+    }
+}
+
+int main()
+{
+    CoopTaskBase::useReadyQueue();
+    for (auto policy : { Policy::RoundRobin, Policy::FixedPriority, Policy::WeightedFair })
+    {
+        for (size_t backgroundCount : { 1, 4, 16, 64 })
+        {
+            if (!measure(policy, backgroundCount)) return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,245 @@
+// microbench.cpp
+// This benchmark suite measures the basic costs of CoopTask scheduling and synchronization:
+// yield round-trip through runCoopTasks(), task creation and destruction through createCoopTask(), with heap allocated
+// stacks and, on Linux, with stacks from CoopTaskStackAllocatorFromPool, spawning and running
+// a task from a CoopTaskPool, CoopSemaphore post to wait handoff, waking 8 waiting tasks by as many post() calls
+// or by one post(8), CoopMutex lock/unlock under contention, and the runCoopTasks() pass
+// cost versus the number of tasks. Each benchmark runs with the default scheduler and in
+// ready queue mode.
+// Results are written to stdout as one JSON object per line, for instance:
+// {"benchmark":"yield_roundtrip","mode":"scan","tasks":1,"ops":2000000,"ns_per_op":93.6}
+// Build on Linux, for instance: g++ -std=c++17 -O2 -I../../src microbench.cpp ../../src/*.cpp -o microbench
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include "CoopTask.h"
+#include "CoopTaskPool.h"
+#include "CoopSemaphore.h"
+#include "CoopMutex.h"
+
+namespace
+{
+    constexpr size_t TASKSTACKSIZE = 0x1000;
+
+    using Clock = std::chrono::steady_clock;
+
+    void report(const char* benchmark, size_t tasks, uint64_t ops, Clock::duration elapsed)
+    {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        std::cout << "{\"benchmark\":\"" << benchmark << "\",\"mode\":\"" << (CoopTaskBase::readyQueueMode() ? "ready" : "scan")
+            << "\",\"tasks\":" << tasks << ",\"ops\":" << ops << ",\"ns_per_op\":" << static_cast<double>(ns) / ops << '}' << std::endl;
+    }
+
+    // Runs the scheduler until the given number of tasks has exited, deleting each of them.
+    void runUntilExited(size_t tasksCount)
+    {
+        size_t exited = 0;
+        const auto reaper = [&exited](const CoopTaskBase* const task)
+        {
+            ++exited;
+            delete task;
+        };
+        while (exited < tasksCount)
+        {
+            runCoopTasks(reaper);
+        }
+    }
+
+    bool yieldRoundtrip()
+    {
+        constexpr uint64_t OPS = 2000000;
+        auto task = createCoopTask<void>(std::string("yield"), []() noexcept
+            {
+                for (;;) yield();
+            }, TASKSTACKSIZE);
+        if (!task) return false;
+        runCoopTasks();
+        // each pass of the scheduler resumes the task once, up to its next yield()
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < OPS; ++i)
+        {
+            runCoopTasks();
+        }
+        report("yield_roundtrip", 1, OPS, Clock::now() - start);
+        delete task;
+        return true;
+    }
+
+    template<class StackAllocator = CoopTaskStackAllocator>
+    bool createDestroy(const char* benchmark = "create_destroy")
+    {
+        constexpr uint64_t OPS = 100000;
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < OPS; ++i)
+        {
+            auto task = createCoopTask<void, StackAllocator>(std::string("create"), []() noexcept {}, TASKSTACKSIZE);
+            if (!task) return false;
+            delete task;
+        }
+        report(benchmark, 1, OPS, Clock::now() - start);
+        return true;
+    }
+
+    bool createRunDestroy()
+    {
+        constexpr uint64_t OPS = 100000;
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < OPS; ++i)
+        {
+            if (!createCoopTask<void>(std::string("spawn"), []() noexcept {}, TASKSTACKSIZE)) return false;
+            runUntilExited(1);
+        }
+        report("create_run_destroy", 1, OPS, Clock::now() - start);
+        return true;
+    }
+
+    bool spawnRunPooled()
+    {
+        constexpr uint64_t OPS = 100000;
+        CoopTaskPool<> pool(std::string("spawn"), 1, TASKSTACKSIZE);
+        if (!pool.size()) return false;
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < OPS; ++i)
+        {
+            if (!pool.spawn([]() noexcept {})) return false;
+            runCoopTasks();
+        }
+        report("spawn_run_pooled", 1, OPS, Clock::now() - start);
+        return true;
+    }
+
+    bool semaphoreHandoff()
+    {
+        constexpr uint64_t OPS = 500000;
+        CoopSemaphore ping(0);
+        CoopSemaphore pong(0);
+        auto pinger = createCoopTask<void>(std::string("ping"), [&ping, &pong]() noexcept
+            {
+                for (uint64_t i = 0; i < OPS / 2; ++i)
+                {
+                    ping.post();
+                    pong.wait();
+                }
+            }, TASKSTACKSIZE);
+        auto ponger = createCoopTask<void>(std::string("pong"), [&ping, &pong]() noexcept
+            {
+                for (uint64_t i = 0; i < OPS / 2; ++i)
+                {
+                    ping.wait();
+                    pong.post();
+                }
+            }, TASKSTACKSIZE);
+        if (!pinger || !ponger) return false;
+        const auto start = Clock::now();
+        runUntilExited(2);
+        report("semaphore_handoff", 2, OPS, Clock::now() - start);
+        return true;
+    }
+
+    bool semaphoreFanout(bool batched)
+    {
+        constexpr uint64_t ROUNDS = 100000;
+        constexpr size_t WORKERS = 8;
+        CoopSemaphore sem(0);
+        uint64_t acquired = 0;
+        bool quit = false;
+        for (size_t i = 0; i < WORKERS; ++i)
+        {
+            auto task = createCoopTask<void>(std::string("worker"), [&sem, &acquired, &quit]() noexcept
+                {
+                    while (!quit)
+                    {
+                        sem.wait();
+                        ++acquired;
+                        yield();
+                    }
+                }, TASKSTACKSIZE);
+            if (!task) return false;
+        }
+        runCoopTasks();
+        const auto start = Clock::now();
+        for (uint64_t round = 1; round <= ROUNDS; ++round)
+        {
+            if (batched) sem.post(WORKERS);
+            else for (size_t i = 0; i < WORKERS; ++i) sem.post();
+            while (acquired < round * WORKERS) runCoopTasks();
+            // let the workers return to wait()
+            runCoopTasks();
+        }
+        report(batched ? "semaphore_fanout_batched" : "semaphore_fanout", WORKERS, ROUNDS, Clock::now() - start);
+        quit = true;
+        sem.post(WORKERS);
+        runUntilExited(WORKERS);
+        return true;
+    }
+
+    bool mutexContention(size_t tasksCount)
+    {
+        constexpr uint64_t OPS = 200000;
+        CoopMutex mutex(tasksCount);
+        for (size_t i = 0; i < tasksCount; ++i)
+        {
+            // every task yields while holding the lock, so that the others contend for it
+            auto task = createCoopTask<void>(std::string("mutex"), [&mutex, tasksCount]() noexcept
+                {
+                    for (uint64_t i = 0; i < OPS / tasksCount; ++i)
+                    {
+                        CoopMutexLock lock(mutex);
+                        yield();
+                    }
+                }, TASKSTACKSIZE);
+            if (!task) return false;
+        }
+        const auto start = Clock::now();
+        runUntilExited(tasksCount);
+        report("mutex_contention", tasksCount, OPS / tasksCount * tasksCount, Clock::now() - start);
+        return true;
+    }
+
+    bool passCost(size_t tasksCount)
+    {
+        const uint64_t passes = std::max<uint64_t>(100, 1000000 / tasksCount);
+        std::vector<CoopTask<void>*> tasks;
+        for (size_t i = 0; i < tasksCount; ++i)
+        {
+            auto task = createCoopTask<void>(std::string("pass"), []() noexcept
+                {
+                    for (;;) yield();
+                }, TASKSTACKSIZE);
+            if (!task) return false;
+            tasks.push_back(task);
+        }
+        runCoopTasks();
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < passes; ++i)
+        {
+            runCoopTasks();
+        }
+        report("pass_cost", tasksCount, passes, Clock::now() - start);
+        for (auto task : tasks) delete task;
+        return true;
+    }
+}
+
+int main()
+{
+    for (bool readyQueue : { false, true })
+    {
+        CoopTaskBase::useReadyQueue(readyQueue);
+        if (!yieldRoundtrip() || !createDestroy() || !createRunDestroy() || !spawnRunPooled() || !semaphoreHandoff() ||
+            !semaphoreFanout(false) || !semaphoreFanout(true)) return 1;
+#if defined(__linux__)
+        if (!createDestroy<CoopTaskStackAllocatorFromPool<TASKSTACKSIZE>>("create_destroy_pooled")) return 1;
+#endif
+        for (size_t tasksCount : { 2, 8 })
+        {
+            if (!mutexContention(tasksCount)) return 1;
+        }
+        for (size_t tasksCount : { 1, 10, 100, 1000 })
+        {
+            if (!passCost(tasksCount)) return 1;
+        }
+    }
+    return 0;
+}
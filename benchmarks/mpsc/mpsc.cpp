@@ -0,0 +1,72 @@
+// mpsc.cpp
+// This benchmark measures the throughput of a multi-producer, single-consumer queue, with 1 to 16
+// producer threads pushing into one queue that a single consumer thread pops from, comparing
+// circular_queue_mp, that serializes producers by a mutex, to the lock-free circular_queue_mpsc.
+// Results are written to stdout as one JSON object per line, like those of microbench.
+// Build on Linux, for instance: g++ -std=c++17 -O2 -pthread -I../../src mpsc.cpp -o mpsc
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "circular_queue/circular_queue_mp.h"
+#include "circular_queue/circular_queue_mpsc.h"
+
+namespace
+{
+    constexpr size_t QUEUECAPACITY = 1024;
+    constexpr uint64_t OPS = 2000000;
+
+    template<typename Queue>
+    bool measure(const char* queueName, size_t producersCount)
+    {
+        Queue queue(QUEUECAPACITY);
+        const uint64_t perProducer = OPS / producersCount;
+        std::vector<std::thread> producers;
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < producersCount; ++p)
+        {
+            producers.emplace_back([&queue, perProducer]()
+                {
+                    for (uint64_t i = 1; i <= perProducer; ++i)
+                    {
+                        while (!queue.push(i)) std::this_thread::yield();
+                    }
+                });
+        }
+        // the sum of all values checks that no element is lost or duplicated
+        const uint64_t expected = producersCount * perProducer * (perProducer + 1) / 2;
+        uint64_t sum = 0;
+        for (uint64_t popped = 0; popped < producersCount * perProducer;)
+        {
+            const auto val = queue.pop();
+            if (val)
+            {
+                sum += val;
+                ++popped;
+            }
+            else std::this_thread::yield();
+        }
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        for (auto& producer : producers) producer.join();
+        if (sum != expected)
+        {
+            std::cerr << queueName << " lost elements with " << producersCount << " producers" << std::endl;
+            return false;
+        }
+        const uint64_t ops = producersCount * perProducer;
+        std::cout << "{\"benchmark\":\"mpsc_throughput\",\"queue\":\"" << queueName << "\",\"producers\":" << producersCount
+            << ",\"ops\":" << ops << ",\"ns_per_op\":" << static_cast<double>(ns) / ops << '}' << std::endl;
+        return true;
+    }
+}
+
+int main()
+{
+    for (size_t producersCount : { 1, 2, 4, 8, 16 })
+    {
+        if (!measure<circular_queue_mp<uint64_t>>("mutex", producersCount)) return 1;
+        if (!measure<circular_queue_mpsc<uint64_t>>("lockfree", producersCount)) return 1;
+    }
+    return 0;
+}
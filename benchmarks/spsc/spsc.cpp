@@ -0,0 +1,86 @@
+// spsc.cpp
+// This benchmark measures the throughput of a single-producer, single-consumer circular_queue
+// transferring small types from a producer thread to a consumer thread, comparing the compact layout,
+// where the producer's and the consumer's indices share a cache line, to the padded layout,
+// and circular_queue to circular_queue_fixed, that masks its indices instead of wrapping them by modulo.
+// Results are written to stdout as one JSON object per line, like those of microbench.
+// Build on Linux, for instance: g++ -std=c++17 -O2 -pthread -I../../src spsc.cpp -o spsc
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include "circular_queue/circular_queue.h"
+#include "circular_queue/circular_queue_fixed.h"
+
+namespace
+{
+    constexpr size_t QUEUECAPACITY = 1024;
+    constexpr uint64_t OPS = 10000000;
+
+    template<typename T, bool Padded>
+    struct Queue : circular_queue<T, void, Padded>
+    {
+        static constexpr const char* name = "circular_queue";
+        Queue() : circular_queue<T, void, Padded>(QUEUECAPACITY) {}
+    };
+
+    template<typename T, bool Padded>
+    struct FixedQueue : circular_queue_fixed<T, QUEUECAPACITY, void, Padded>
+    {
+        static constexpr const char* name = "circular_queue_fixed";
+    };
+
+    template<template<typename, bool> class Q, typename T, bool Padded>
+    bool measure(const char* typeName)
+    {
+        Q<T, Padded> queue;
+        // values are never 0, that is what pop() returns from an empty queue
+        const auto value = [](uint64_t i) { return static_cast<T>(i % 250 + 1); };
+        const auto start = std::chrono::steady_clock::now();
+        std::thread producer([&queue, &value]()
+            {
+                for (uint64_t i = 0; i < OPS; ++i)
+                {
+                    while (!queue.push(value(i))) std::this_thread::yield();
+                }
+            });
+        // the sum of all values checks that no element is lost or duplicated
+        uint64_t expected = 0;
+        for (uint64_t i = 0; i < OPS; ++i) expected += value(i);
+        uint64_t sum = 0;
+        for (uint64_t popped = 0; popped < OPS;)
+        {
+            const auto val = queue.pop();
+            if (val)
+            {
+                sum += val;
+                ++popped;
+            }
+            else std::this_thread::yield();
+        }
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        producer.join();
+        if (sum != expected)
+        {
+            std::cerr << Q<T, Padded>::name << ' ' << typeName << " lost elements in the " << (Padded ? "padded" : "compact") << " layout" << std::endl;
+            return false;
+        }
+        std::cout << "{\"benchmark\":\"spsc_throughput\",\"queue\":\"" << Q<T, Padded>::name
+            << "\",\"layout\":\"" << (Padded ? "padded" : "compact") << "\",\"type\":\"" << typeName
+            << "\",\"ops\":" << OPS << ",\"ns_per_op\":" << static_cast<double>(ns) / OPS << '}' << std::endl;
+        return true;
+    }
+
+    template<typename T>
+    bool measure(const char* typeName)
+    {
+        return measure<Queue, T, false>(typeName) && measure<Queue, T, true>(typeName) &&
+            measure<FixedQueue, T, false>(typeName) && measure<FixedQueue, T, true>(typeName);
+    }
+}
+
+int main()
+{
+    if (!measure<uint8_t>("uint8_t") || !measure<uint32_t>("uint32_t") || !measure<uint64_t>("uint64_t")) return 1;
+    return 0;
+}
@@ -0,0 +1,71 @@
+// taskcount.cpp
+// This benchmark measures the cost of a runCoopTasks() scheduling pass at 10, 1k, and 100k tasks.
+// Each task count is run with all tasks yielding, and with all but 10 tasks sleeping,
+// once with the default scheduler that scans getRunnableTasks(), and once in ready queue mode.
+// Results are written to stdout as one JSON object per line, like those of microbench.
+// Build on Linux, for instance: g++ -std=c++17 -O2 -I../../src taskcount.cpp ../../src/*.cpp -o taskcount
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include "CoopTask.h"
+
+namespace
+{
+    constexpr size_t TASKSTACKSIZE = 0x1000;
+    constexpr size_t ACTIVETASKS = 10;
+
+    bool measure(bool readyQueue, size_t tasksCount, bool allActive)
+    {
+        CoopTaskBase::useReadyQueue(readyQueue);
+        std::vector<CoopTask<void>*> tasks;
+        tasks.reserve(tasksCount);
+        for (size_t i = 0; i < tasksCount; ++i)
+        {
+            const bool active = allActive || i < ACTIVETASKS;
+            auto task = createCoopTask<void>(std::string("task"), [active]() noexcept
+                {
+                    for (;;)
+                    {
+                        if (active) yield();
+                        else CoopTaskBase::sleep();
+                    }
+                }, TASKSTACKSIZE);
+            if (!task)
+            {
+                std::cerr << "CoopTask " << i << " not created" << std::endl;
+                return false;
+            }
+            tasks.push_back(task);
+        }
+        // the first pass initializes every task
+        runCoopTasks();
+
+        const size_t passes = std::max<size_t>(10, 1000000 / tasksCount);
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < passes; ++i)
+        {
+            runCoopTasks();
+        }
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "{\"benchmark\":\"pass_cost\",\"mode\":\"" << (readyQueue ? "ready" : "scan") << "\",\"tasks\":" << tasksCount
+            << ",\"runnable\":" << (allActive ? tasksCount : ACTIVETASKS) << ",\"ops\":" << passes
+            << ",\"ns_per_op\":" << static_cast<double>(ns) / passes << '}' << std::endl;
+
+        for (auto task : tasks) delete task;
+        return true;
+    }
+}
+
+int main()
+{
+    for (bool readyQueue : { false, true })
+    {
+        for (size_t tasksCount : { 10, 1000, 100000 })
+        {
+            if (!measure(readyQueue, tasksCount, true)) return 1;
+            if (tasksCount > ACTIVETASKS && !measure(readyQueue, tasksCount, false)) return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+// poller.cpp
+// This is a Linux example of CoopTasks that wait on file descriptors.
+// A writer task sends messages over a socket pair, a reader task receives them
+// with CoopPoller::waitReadable(), and times out once the writer has stopped.
+// CoopPoller::runTasks() blocks in CoopPoller::poll() instead of spinning while all tasks wait.
+
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "CoopTask.h"
+#include "CoopPoller.h"
+
+int main()
+{
+    CoopPoller poller;
+    int fds[2];
+    if (!poller || socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        std::cerr << "poller setup failed" << std::endl;
+        return 1;
+    }
+    for (auto fd : fds) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    auto& writer = *createCoopTask<void>(std::string("writer"), [&poller, &fds]() noexcept
+        {
+            for (int i = 0; i < 5; ++i)
+            {
+                delay(200);
+                const char msg[] = "ping";
+                if (!poller.waitWritable(fds[0]) || ::write(fds[0], msg, sizeof(msg) - 1) < 0) break;
+            }
+        }, 0x2000);
+    if (!writer) std::cerr << writer.name() << " CoopTask not created" << std::endl;
+
+    auto& reader = *createCoopTask<int>(std::string("reader"), [&poller, &fds]() noexcept
+        {
+            int received = 0;
+            while (poller.waitReadable(fds[1], 1000))
+            {
+                char buf[64];
+                const auto len = ::read(fds[1], buf, sizeof(buf));
+                if (len <= 0) break;
+                std::cerr << "received " << std::string(buf, len) << std::endl;
+                ++received;
+            }
+            std::cerr << "reader timed out" << std::endl;
+            return received;
+        }, 0x2000);
+    if (!reader) std::cerr << reader.name() << " CoopTask not created" << std::endl;
+
+    bool done = false;
+    auto taskReaper = [&reader, &done](const CoopTaskBase* const task)
+    {
+        if (task == &reader)
+        {
+            std::cerr << task->name() << " returns = " << reader.exitCode() << std::endl;
+            done = true;
+        }
+        delete task;
+    };
+
+    while (!done)
+    {
+        poller.runTasks(taskReaper);
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return 0;
+}
@@ -18,6 +18,10 @@ CoopMutex blinkMutex;
 
 int main()
 {
+#if defined(__linux__)
+    // block in runCoopTasks() while all tasks sleep, instead of spinning the loop below
+    CoopTaskBase::useBlockingIdle();
+#endif
     CoopSemaphore terminatorSema(0);
     CoopSemaphore helloSema(0);
 
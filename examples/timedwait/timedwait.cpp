@@ -0,0 +1,68 @@
+// timedwait.cpp
+// This is a Linux example of timed CoopSemaphore waits, which also checks that a task that
+// timed out on a semaphore is no longer woken up by a later post() on it.
+// A waiter task waits on a semaphore for 20 ms, which nobody posts in time, and then
+// sleeps for 1 s with sleepFor(). A taker task waits on the same semaphore without a timeout.
+// The post() that follows the timeout must wake the taker and leave the waiter's sleep alone.
+// The example runs on CoopManualClock, such that time only passes when main() advances it.
+// It returns 0 if the taker got the post and the waiter slept for the full second, 1 otherwise.
+
+#include <iostream>
+#include "CoopTask.h"
+#include "CoopSemaphore.h"
+
+int main()
+{
+    CoopTaskBase::useClock(CoopManualClock::now);
+    CoopSemaphore sem(0);
+    bool timedOut = false;
+    bool slept = false;
+    bool taken = false;
+
+    auto& waiter = *createCoopTask<void>(std::string("waiter"), [&sem, &timedOut, &slept]() noexcept
+        {
+            timedOut = !sem.wait(20);
+            std::cerr << "waiter timed out = " << timedOut << std::endl;
+            CoopTaskBase::self()->sleepFor(1000);
+            yield();
+            slept = true;
+        }, 0x2000);
+    if (!waiter)
+    {
+        std::cerr << waiter.name() << " CoopTask not created" << std::endl;
+        return 1;
+    }
+
+    auto& taker = *createCoopTask<void>(std::string("taker"), [&sem, &timedOut, &taken]() noexcept
+        {
+            while (!timedOut) yield();
+            taken = sem.wait();
+        }, 0x2000);
+    if (!taker)
+    {
+        std::cerr << taker.name() << " CoopTask not created" << std::endl;
+        return 1;
+    }
+
+    auto taskReaper = [](const CoopTaskBase* const task) { delete task; };
+    uint32_t ms = 0;
+    for (; ms < 50 && !timedOut; ++ms)
+    {
+        runCoopTasks(taskReaper);
+        CoopManualClock::advance(1000000UL);
+    }
+    for (int i = 0; i < 10; ++i) runCoopTasks(taskReaper);
+    // the taker gets the post, the waiter must sleep on
+    sem.post();
+    for (int i = 0; i < 10; ++i) runCoopTasks(taskReaper);
+    std::cerr << "taker got the post = " << taken << std::endl;
+    if (slept)
+    {
+        std::cerr << "FAILED: post() woke up the waiter from sleepFor() after " << ms << " ms" << std::endl;
+        return 1;
+    }
+    CoopManualClock::advance(1000000000UL);
+    for (int i = 0; i < 10 && !slept; ++i) runCoopTasks(taskReaper);
+    std::cerr << "waiter slept for the full second = " << slept << std::endl;
+    return timedOut && taken && slept ? 0 : 1;
+}
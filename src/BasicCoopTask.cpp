@@ -22,6 +22,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #if defined(ARDUINO) && !defined(ESP32_FREERTOS)
 #include <alloca.h>
 #endif
+#if defined(__linux__) && !defined(ARDUINO)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if !defined(ARDUINO)
+#include <istream>
+#include <ostream>
+#endif
 
 #if !defined(_MSC_VER) && !defined(ESP32_FREERTOS)
 
@@ -41,6 +49,80 @@ char* CoopTaskStackAllocator::allocateStack(size_t stackSize)
 
 #endif // !defined(_MSC_VER) && !defined(ESP32_FREERTOS)
 
+#if defined(__linux__) && !defined(ARDUINO)
+
+CoopTaskStackPool::CoopTaskStackPool(size_t stackSize, bool demandPaged, size_t slotsPerChunk) :
+    pageSize(static_cast<size_t>(sysconf(_SC_PAGESIZE))),
+    slotSize(pageSize + (stackSize + 2 * sizeof(CoopTaskBase::STACKCOOKIE) + pageSize - 1) / pageSize * pageSize),
+    slotsPerChunk(slotsPerChunk ? slotsPerChunk : 1),
+    demandPaged(demandPaged)
+{
+}
+
+char* CoopTaskStackPool::allocate()
+{
+    for (;;)
+    {
+        while (lock.test_and_set(std::memory_order_acquire)) {}
+        char* stackTop = freeStacks;
+        if (stackTop)
+        {
+            freeStacks = freeLink(stackTop);
+        }
+        else if (chunkNext != chunkEnd)
+        {
+            // the stack grows down, the guard page is at the low end of the slot
+            stackTop = chunkNext + pageSize;
+            chunkNext += slotSize;
+        }
+        lock.clear(std::memory_order_release);
+        if (stackTop) return stackTop;
+
+        // system calls can take long, other threads keep allocating and releasing meanwhile
+        char* chunk = mapChunk();
+        if (!chunk) return nullptr;
+        while (lock.test_and_set(std::memory_order_acquire)) {}
+        const bool published = chunkNext == chunkEnd;
+        if (published)
+        {
+            chunkNext = chunk;
+            chunkEnd = chunk + slotsPerChunk * slotSize;
+        }
+        lock.clear(std::memory_order_release);
+        // another thread has published a chunk first
+        if (!published) munmap(chunk, slotsPerChunk * slotSize);
+    }
+}
+
+char* CoopTaskStackPool::mapChunk() const
+{
+    // reserves address space only, pages are committed as the stacks are used
+    void* chunk = mmap(nullptr, slotsPerChunk * slotSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == chunk) return nullptr;
+    for (size_t slot = 0; slot < slotsPerChunk; ++slot)
+    {
+        if (mprotect(static_cast<char*>(chunk) + slot * slotSize, pageSize, PROT_NONE))
+        {
+            munmap(chunk, slotsPerChunk * slotSize);
+            return nullptr;
+        }
+    }
+    return static_cast<char*>(chunk);
+}
+
+void CoopTaskStackPool::release(char* stackTop)
+{
+    // the next task starts out with untouched pages
+    if (demandPaged) madvise(stackTop, slotSize - pageSize, MADV_DONTNEED);
+    while (lock.test_and_set(std::memory_order_acquire)) {}
+    freeLink(stackTop) = freeStacks;
+    freeStacks = stackTop;
+    lock.clear(std::memory_order_release);
+}
+
+#endif // defined(__linux__) && !defined(ARDUINO)
+
 #if (defined(ARDUINO) && !defined(ESP32_FREERTOS)) || defined(__GNUC__)
 
 char* CoopTaskStackAllocatorFromLoopBase::allocateStack(size_t loopReserve, size_t stackSize)
@@ -59,3 +141,67 @@ char* CoopTaskStackAllocatorFromLoopBase::allocateStack(size_t loopReserve, size
 }
 
 #endif // (defined(ARDUINO) && !defined(ESP32_FREERTOS)) || defined(__GNUC__)
+
+#if !defined(ARDUINO)
+
+std::mutex CoopTaskStackProfile::mutex;
+std::map<std::string, size_t> CoopTaskStackProfile::peaks;
+std::atomic<bool> CoopTaskStackProfile::profiling(false);
+
+void CoopTaskStackProfile::enable(bool state)
+{
+    profiling.store(state);
+}
+
+void CoopTaskStackProfile::record(const CoopTaskBase& task)
+{
+    // checked without the lock, deleting tasks stays cheap while profiling is off
+    if (!enabled()) return;
+    // getPeakStack() scans the whole free stack, such that stacks sized by the profile hold the exact peak
+    const size_t peak = task.getPeakStack();
+    if (peak) record(task.name(), peak);
+}
+
+void CoopTaskStackProfile::record(const std::string& name, size_t peak)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& entry = peaks[name];
+    if (peak > entry) entry = peak;
+}
+
+size_t CoopTaskStackProfile::peak(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = peaks.find(name);
+    return entry != peaks.end() ? entry->second : 0;
+}
+
+void CoopTaskStackProfile::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    peaks.clear();
+}
+
+void CoopTaskStackProfile::save(std::ostream& os)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : peaks)
+    {
+        os << entry.first << '\t' << entry.second << '\n';
+    }
+}
+
+bool CoopTaskStackProfile::load(std::istream& is)
+{
+    std::string name;
+    while (std::getline(is, name, '\t'))
+    {
+        size_t peak;
+        if (!(is >> peak)) return false;
+        is.ignore(1);
+        record(name, peak);
+    }
+    return is.eof();
+}
+
+#endif // !defined(ARDUINO)
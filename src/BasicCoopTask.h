@@ -21,6 +21,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define __BasicCoopTask_h
 
 #include "CoopTaskBase.h"
+#if !defined(ARDUINO)
+#include <type_traits>
+#include <iosfwd>
+#include <atomic>
+#include <map>
+#include <mutex>
+#endif
 
 class CoopTaskStackAllocator
 {
@@ -77,6 +84,142 @@ public:
 #endif
 };
 
+#if defined(__linux__) && !defined(ARDUINO)
+/// A pool of equally sized task stacks in mmap'ed memory. Each stack has an inaccessible guard
+/// page below it, such that an overflow faults right at the offending instruction. Released stacks
+/// are kept for reuse, the memory is never unmapped.
+class CoopTaskStackPool
+{
+public:
+    /// @param stackSize the size of each stack, excluding the stack cookies.
+    /// @param demandPaged true: the pages of released stacks are returned to the system, such that
+    /// each task commits only the stack pages it touches.
+    /// @param slotsPerChunk the number of stacks mapped at once when the pool runs empty.
+    CoopTaskStackPool(size_t stackSize, bool demandPaged = false, size_t slotsPerChunk = 64);
+    CoopTaskStackPool(const CoopTaskStackPool&) = delete;
+    CoopTaskStackPool& operator=(const CoopTaskStackPool&) = delete;
+
+    /// @returns: the lowest address of the stack, as for CoopTaskStackAllocator::allocateStack(),
+    /// nullptr if no memory can be mapped.
+    char* allocate();
+    void release(char* stackTop);
+
+protected:
+    const size_t pageSize;
+    // guard page and stack, rounded up to whole pages
+    const size_t slotSize;
+    const size_t slotsPerChunk;
+    const bool demandPaged;
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    // released stacks, linked through their last bytes, that any task touches first
+    char* freeStacks = nullptr;
+    char*& freeLink(char* stackTop) const
+    {
+        return reinterpret_cast<char**>(stackTop + slotSize - pageSize)[-1];
+    }
+    // maps a chunk of slotsPerChunk slots and protects their guard pages, without holding the lock
+    char* mapChunk() const;
+    // unused remainder of the most recently mapped chunk
+    char* chunkNext = nullptr;
+    char* chunkEnd = nullptr;
+};
+
+/// Allocates task stacks of up to StackSize bytes from a CoopTaskStackPool, one pool per StackSize.
+/// After the pool has warmed up, creating and deleting tasks needs no heap allocation for their stacks.
+/// Each stack uses two memory mappings, mind the system limit of mappings per process (vm.max_map_count).
+/// With DemandPaged, stacks are not filled with cookies, only their touched pages get committed, and
+/// getFreeStack() measures the untouched pages. This allows for large stacks at little memory cost.
+template<size_t StackSize = CoopTaskBase::DEFAULTTASKSTACKSIZE, bool DemandPaged = false>
+class CoopTaskStackAllocatorFromPool
+{
+public:
+    static constexpr size_t DEFAULTTASKSTACKSIZE =
+        (sizeof(unsigned) >= 4) ? ((StackSize + sizeof(unsigned) - 1) / sizeof(unsigned)) * sizeof(unsigned) : StackSize;
+    static constexpr bool DEMANDPAGED = DemandPaged;
+
+    static char* allocateStack(size_t stackSize)
+    {
+        return (DEFAULTTASKSTACKSIZE >= stackSize) ? pool().allocate() : nullptr;
+    }
+    static void disposeStack(char* stackTop)
+    {
+        if (stackTop) pool().release(stackTop);
+    }
+
+protected:
+    static CoopTaskStackPool& pool()
+    {
+        static CoopTaskStackPool stackPool(DEFAULTTASKSTACKSIZE, DemandPaged);
+        return stackPool;
+    }
+};
+
+/// true if the StackAllocator declares DEMANDPAGED stacks.
+template<class StackAllocator, class = void>
+struct CoopTaskStackIsDemandPaged : std::false_type {};
+template<class StackAllocator>
+struct CoopTaskStackIsDemandPaged<StackAllocator, decltype(void(StackAllocator::DEMANDPAGED))> :
+    std::integral_constant<bool, StackAllocator::DEMANDPAGED> {};
+#endif
+
+#if !defined(ARDUINO)
+/// A table of the peak stack usage of tasks, keyed by CoopTaskBase::name(). While profiling
+/// is enabled, each task is recorded when it gets deleted. The table can be saved and loaded
+/// again by a later run, for CoopTaskStackAllocatorProfiled to size the stacks of new tasks.
+class CoopTaskStackProfile
+{
+public:
+    /// @param state true: The parameter default value. Deleted tasks are recorded.
+    static void enable(bool state = true);
+    static bool enabled() { return profiling.load(std::memory_order_relaxed); }
+    /// Records the peak stack usage of the task so far, for instance for tasks that never exit.
+    static void record(const CoopTaskBase& task);
+    /// Records a peak stack usage of the named tasks, the table keeps the maximum.
+    static void record(const std::string& name, size_t peak);
+    /// @returns: the recorded peak stack usage of the named tasks, 0 if there is none.
+    static size_t peak(const std::string& name);
+    static void clear();
+    /// Writes the table as lines of name, tab, and peak stack usage.
+    static void save(std::ostream& os);
+    /// Merges a table from the format of save() into the table.
+    /// @returns: true if the input was read to its end without format errors.
+    static bool load(std::istream& is);
+
+protected:
+    static std::mutex mutex;
+    static std::map<std::string, size_t> peaks;
+    static std::atomic<bool> profiling;
+};
+
+/// A StackAllocator policy that sizes the stacks of new tasks by the CoopTaskStackProfile of
+/// tasks by the same name, with a safety margin, and otherwise allocates like StackAllocator.
+/// The requested stack size is the upper limit, and is used for tasks without a profile.
+template<class StackAllocator = CoopTaskStackAllocator, unsigned MarginPercent = 25, size_t MinMargin = 0x100>
+class CoopTaskStackAllocatorProfiled : public StackAllocator
+{
+public:
+    static size_t stackSizeFor(const std::string& name, size_t stackSize)
+    {
+        const size_t peak = CoopTaskStackProfile::peak(name);
+        if (!peak) return stackSize;
+        const size_t tuned = peak + peak * MarginPercent / 100 + MinMargin;
+        return tuned < stackSize ? tuned : stackSize;
+    }
+};
+
+/// Calls StackAllocator::stackSizeFor(), if it exists.
+template<class StackAllocator, class = void>
+struct CoopTaskStackSizing
+{
+    static size_t stackSizeFor(const std::string&, size_t stackSize) { return stackSize; }
+};
+template<class StackAllocator>
+struct CoopTaskStackSizing<StackAllocator, decltype(void(&StackAllocator::stackSizeFor))>
+{
+    static size_t stackSizeFor(const std::string& name, size_t stackSize) { return StackAllocator::stackSizeFor(name, stackSize); }
+};
+#endif
+
 template<class StackAllocator = CoopTaskStackAllocator> class BasicCoopTask : public CoopTaskBase
 {
 public:
@@ -87,6 +230,13 @@ public:
 #endif
         CoopTaskBase(name, _func, stackSize)
     {
+#if !defined(ARDUINO)
+        const size_t stackSizeFor = CoopTaskStackSizing<StackAllocator>::stackSizeFor(name, taskStackSize);
+        taskStackSize = ((stackSizeFor + sizeof(unsigned) - 1) / sizeof(unsigned)) * sizeof(unsigned);
+#endif
+#if defined(__linux__) && !defined(ARDUINO)
+        stackDemandPaged = CoopTaskStackIsDemandPaged<StackAllocator>::value;
+#endif
 #if !defined(_MSC_VER) && !defined(ESP32_FREERTOS)
         taskStackTop = stackAllocator.allocateStack(taskStackSize);
 #endif
@@ -95,16 +245,19 @@ public:
     BasicCoopTask& operator=(const BasicCoopTask&) = delete;
     ~BasicCoopTask()
     {
+#if !defined(ARDUINO)
+        CoopTaskStackProfile::record(*this);
+#endif
 #if !defined(_MSC_VER) && !defined(ESP32_FREERTOS)
         stackAllocator.disposeStack(taskStackTop);
 #endif
     }
     /// Every task is entered into this list by scheduleTask(). It is removed when it exits
     /// or gets deleted.
-    static const std::array< std::atomic<BasicCoopTask* >, MAXNUMBERCOOPTASKS + 1>& getRunnableTasks()
+    static const RunnableTasks<BasicCoopTask>& getRunnableTasks()
     {
         // this is safe to do because CoopTaskBase ctor is protected.
-        return reinterpret_cast<const std::array< std::atomic<BasicCoopTask* >, MAXNUMBERCOOPTASKS + 1>&>(CoopTaskBase::getRunnableTasks());
+        return reinterpret_cast<const RunnableTasks<BasicCoopTask>&>(CoopTaskBase::getRunnableTasks());
     }
 protected:
     StackAllocator stackAllocator;
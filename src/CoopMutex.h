@@ -23,12 +23,43 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "CoopSemaphore.h"
 
 /// A mutex that is safe to use from CoopTasks.
+/// While tasks of higher priority wait on the mutex, its owner inherits the highest of their priorities,
+/// such that tasks of medium priority cannot starve it in ready queue mode, and the wait of the
+/// high priority task is bounded by the time the owner holds the mutex.
+/// The inherited priority is dropped when the owner unlocks the last CoopMutex it holds.
+/// Only the default CoopFixedPriorityPolicy schedules by priority, under CoopWeightedFairPolicy
+/// the inherited priority has no effect, and the owner keeps its fair share of the CPU.
+/// Like for CoopSemaphore, with a scheduler per thread, all tasks that lock() the same mutex must
+/// belong to the same scheduler.
 class CoopMutex : private CoopSemaphore
 {
 protected:
     std::atomic<CoopTaskBase*> owner;
 
+    /// @returns: the highest priority of the tasks waiting on the mutex, 0 if there are none.
+    uint8_t waitersPriority() const
+    {
+        uint8_t prio = 0;
+        auto task = pendingTask0.load();
+        if (task) prio = task->priority();
+        for (task = pendingTasks.front(); task; task = pendingTasks.next(task))
+        {
+            if (task->priority() > prio) prio = task->priority();
+        }
+        return prio;
+    }
+
+    void acquired(CoopTaskBase* self)
+    {
+        owner.store(self);
+        ++self->mutexesHeld;
+        // the new owner takes over the priority of the tasks still waiting
+        const auto prio = waitersPriority();
+        if (prio > self->priority()) self->inheritPriority(prio);
+    }
+
 public:
+    /// @param maxPending ignored, the number of concurrently waiting tasks is unlimited; kept for source compatibility.
     CoopMutex(size_t maxPending = 10) : CoopSemaphore(1, maxPending), owner(nullptr) {}
     CoopMutex(const CoopMutex&) = delete;
     CoopMutex& operator=(const CoopMutex&) = delete;
@@ -36,23 +67,28 @@ public:
     /// @returns: true, or false, if the current task does not own the mutex.
     bool unlock()
     {
-        if (CoopTaskBase::running() && CoopTaskBase::self() == owner.load() && post())
+        auto self = CoopTaskBase::self();
+        if (CoopTaskBase::running() && self == owner.load() && post())
         {
             owner.store(nullptr);
+            if (!--self->mutexesHeld) self->inheritPriority(0);
             return true;
         }
         return false;
     }
 
-    /// @returns: true if the mutex becomes locked. false if it is already locked by the same task, or the maximum number of pending tasks is exceeded.
+    /// @returns: true if the mutex becomes locked. false if it is already locked by the same task.
     bool lock()
     {
-        if (CoopTaskBase::running() && CoopTaskBase::self() != owner.load() && wait())
-        {
-            owner.store(CoopTaskBase::self());
-            return true;
-        }
-        return false;
+        if (!CoopTaskBase::running()) return false;
+        auto self = CoopTaskBase::self();
+        auto holder = owner.load();
+        if (self == holder) return false;
+        // the owner runs at least at the priority of this task until it unlocks
+        if (holder && holder->priority() < self->priority()) holder->inheritPriority(self->priority());
+        if (!wait()) return false;
+        acquired(self);
+        return true;
     }
 
     /// @returns: true if the mutex becomes freshly locked without waiting, otherwise false.
@@ -60,7 +96,7 @@ public:
     {
         if (CoopTaskBase::running() && CoopTaskBase::self() != owner.load() && try_wait())
         {
-            owner.store(CoopTaskBase::self());
+            acquired(CoopTaskBase::self());
             return true;
         }
         return false;
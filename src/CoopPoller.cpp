@@ -0,0 +1,151 @@
+/*
+CoopPoller.cpp - Implementation of file descriptor readiness waits for cooperative scheduling tasks
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "CoopPoller.h"
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <unordered_set>
+
+namespace
+{
+    // the clock of CoopTask delays, differences of the truncated value are wrap-around safe
+    uint32_t millis()
+    {
+        return static_cast<uint32_t>(CoopTaskBase::now() / 1000000UL);
+    }
+
+    short pollEvents(uint32_t events)
+    {
+        return (events & EPOLLIN ? POLLIN : 0) | (events & EPOLLRDHUP ? POLLRDHUP : 0) |
+            (events & EPOLLOUT ? POLLOUT : 0);
+    }
+}
+
+CoopPoller::CoopPoller() : epollFd(epoll_create1(EPOLL_CLOEXEC))
+{
+}
+
+CoopPoller::~CoopPoller()
+{
+    if (epollFd >= 0) ::close(epollFd);
+}
+
+bool CoopPoller::wait(int fd, uint32_t events, uint32_t ms)
+{
+    auto self = CoopTaskBase::self();
+    if (!self || epollFd < 0) return false;
+    if (!ms)
+    {
+        // without a timeout, check for readiness and return without parking the task
+        pollfd pfd{ fd, pollEvents(events), 0 };
+        return ::poll(&pfd, 1, 0) > 0 && (pfd.revents & ~POLLNVAL);
+    }
+    // before fd, or the address of self, can be taken over from a task deleted while waiting
+    sweepWaiters();
+    epoll_event ev{};
+    // one-shot, the registration stays disarmed after it fires, and is re-armed by the next wait
+    ev.events = events | EPOLLONESHOT;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0)
+    {
+        if (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) return false;
+    }
+    auto& waiter = waiters[fd];
+    waiter = { self, false };
+    waitingTasks.push_back(self);
+    const uint32_t start = ~ms ? millis() : 0;
+    for (;;)
+    {
+        if (!~ms)
+        {
+            CoopTaskBase::sleep();
+        }
+        else
+        {
+            const uint32_t expired = millis() - start;
+            if (expired >= ms) break;
+            CoopTaskBase::delay(ms - expired);
+        }
+        // other wakeups are spurious
+        if (waiter.ready) break;
+    }
+    const bool ready = waiter.ready;
+    waitingTasks.remove(self);
+    waiters.erase(fd);
+    // the armed registration would wake up the next task that waits on fd
+    if (!ready) epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    return ready;
+}
+
+void CoopPoller::sweepWaiters()
+{
+    if (waiters.size() == waitingTasks.size()) return;
+    std::unordered_set<const CoopTaskBase*> alive;
+    for (auto task = waitingTasks.front(); task; task = waitingTasks.next(task)) alive.insert(task);
+    for (auto it = waiters.begin(); it != waiters.end();)
+    {
+        if (alive.count(it->second.task))
+        {
+            ++it;
+        }
+        else
+        {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, it->first, nullptr);
+            it = waiters.erase(it);
+        }
+    }
+}
+
+int CoopPoller::poll(uint32_t ms)
+{
+    polled = true;
+    if (epollFd < 0) return -1;
+    if (waitingTasks.empty() && !~ms) return 0;
+    sweepWaiters();
+    epoll_event events[MAXEVENTS];
+    const int count = epoll_wait(epollFd, events, MAXEVENTS, ms > INT_MAX ? -1 : static_cast<int>(ms));
+    if (count < 0) return errno == EINTR ? 0 : -1;
+    int woken = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        auto it = waiters.find(events[i].data.fd);
+        if (it == waiters.end() || it->second.ready) continue;
+        it->second.ready = true;
+        it->second.task->scheduleTask(true);
+        ++woken;
+    }
+    return woken;
+}
+
+void CoopPoller::runTasks(const Delegate<void(const CoopTaskBase* const task)>& reaper)
+{
+    polled = false;
+    runCoopTasks(reaper,
+        [this](uint32_t ms) { poll(ms); return false; },
+        [this]() { poll(~0U); return false; });
+    // busy tasks leave no idle time for the hooks
+    if (!polled && !waitingTasks.empty()) poll(0);
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+CoopPoller.h - Implementation of file descriptor readiness waits for cooperative scheduling tasks
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __CoopPoller_h
+#define __CoopPoller_h
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include "CoopTaskBase.h"
+#include "CoopWaitList.h"
+#include <sys/epoll.h>
+#include <unordered_map>
+
+/// An epoll based poller that lets CoopTasks wait for file descriptors to become readable
+/// or writable, without blocking the thread that runs them.
+/// A waiting task sleeps, or is delayed for the timeout, until poll() wakes it up.
+/// runTasks() calls runCoopTasks() with hooks that block in poll() while all tasks are delayed
+/// or sleeping, and polls with a 0 ms timeout after each pass in which other tasks were busy,
+/// such that these don't starve the waiting tasks:
+/// @code
+/// for (;;) poller.runTasks(reaper);
+/// @endcode
+/// A poller, and its waiting tasks, must be used by a single thread that runs CoopTasks.
+/// Only one task at a time may wait on the same file descriptor.
+/// A task may be deleted while it waits.
+class CoopPoller
+{
+protected:
+    struct Waiter
+    {
+        CoopTaskBase* task;
+        bool ready;
+    };
+
+    static constexpr int MAXEVENTS = 64;
+    int epollFd;
+    // the epoll registrations refer to the file descriptor, which keys the waiting task
+    std::unordered_map<int, Waiter> waiters;
+    // a deleted task leaves this list, but not waiters
+    CoopWaitList waitingTasks;
+    bool polled = false;
+
+    /// @param events the epoll events to wait for.
+    /// @param ms the relative timeout measured in milliseconds, ~0 for none.
+    /// @returns: true if any of the events occurred, false on timeout or error.
+    bool wait(int fd, uint32_t events, uint32_t ms);
+    /// Drops the waiters of tasks that were deleted while waiting, and their registrations.
+    void sweepWaiters();
+
+public:
+    CoopPoller();
+    CoopPoller(const CoopPoller&) = delete;
+    CoopPoller& operator=(const CoopPoller&) = delete;
+    /// No task may be waiting on the poller when it is destroyed.
+    ~CoopPoller();
+
+    /// @returns: true if the poller is ready for use.
+    operator bool() const noexcept { return epollFd >= 0; }
+
+    /// Use only in running CoopTask function.
+    /// @param fd the file descriptor, which should be in non-blocking mode.
+    /// @param ms the relative timeout measured in milliseconds, the default ~0 waits indefinitely,
+    /// 0 checks fd without waiting.
+    /// @returns: true if fd is readable, or has a pending error or hangup, false on timeout or error.
+    bool waitReadable(int fd, uint32_t ms = ~0U)
+    {
+        return wait(fd, EPOLLIN | EPOLLRDHUP, ms);
+    }
+
+    /// Use only in running CoopTask function.
+    /// @param fd the file descriptor, which should be in non-blocking mode.
+    /// @param ms the relative timeout measured in milliseconds, the default ~0 waits indefinitely,
+    /// 0 checks fd without waiting.
+    /// @returns: true if fd is writable, or has a pending error or hangup, false on timeout or error.
+    bool waitWritable(int fd, uint32_t ms = ~0U)
+    {
+        return wait(fd, EPOLLOUT, ms);
+    }
+
+    /// @returns: the number of tasks that are waiting on file descriptors.
+    size_t waiting() const noexcept { return waitingTasks.size(); }
+
+    /// Waits for readiness events, and wakes up the tasks that wait for them.
+    /// Must not be called from a CoopTask.
+    /// @param ms the maximum time to block, measured in milliseconds, ~0 blocks until an event
+    /// occurs. If no tasks are waiting, poll() returns immediately for timeouts of ~0.
+    /// @returns: the number of tasks woken up, -1 on error.
+    int poll(uint32_t ms);
+
+    /// Runs a scheduling pass like runCoopTasks(), whose onDelay and onSleep hooks block in poll().
+    /// If tasks were busy, such that no hook ran, and tasks are waiting, it polls with a 0 ms timeout.
+    /// Must not be called from a CoopTask.
+    /// @param reaper the runCoopTasks() reaper.
+    void runTasks(const Delegate<void(const CoopTaskBase* const task)>& reaper = nullptr);
+};
+
+#endif
+
+#endif // __CoopPoller_h
@@ -0,0 +1,88 @@
+/*
+CoopSchedulingPolicy.cpp - Implementation of scheduling policies for cooperative scheduling tasks
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "CoopSchedulingPolicy.h"
+#include "CoopTaskBase.h"
+
+bool CoopFixedPriorityPolicy::before(const CoopTaskBase* a, const CoopTaskBase* b) const noexcept
+{
+    return a->priority() > b->priority();
+}
+
+void CoopFixedPriorityPolicy::beginPass(const CoopTaskBase* first) noexcept
+{
+    passPriority = first->priority();
+}
+
+bool CoopFixedPriorityPolicy::admits(const CoopTaskBase* task) const noexcept
+{
+    return task->priority() >= passPriority;
+}
+
+CoopWeightedFairPolicy::CoopWeightedFairPolicy(uint32_t slice_us) :
+#if defined(ARDUINO)
+    slice(static_cast<uint64_t>(slice_us) << WEIGHTSHIFT)
+#else
+    // virtual times count nanoseconds of CoopTaskBase::now()
+    slice((static_cast<uint64_t>(slice_us) * 1000UL) << WEIGHTSHIFT)
+#endif
+{
+}
+
+void CoopWeightedFairPolicy::readied(CoopTaskBase* task) noexcept
+{
+    if (task->virtualTime < virtualClock) task->virtualTime = virtualClock;
+}
+
+bool CoopWeightedFairPolicy::before(const CoopTaskBase* a, const CoopTaskBase* b) const noexcept
+{
+    return a->virtualTime < b->virtualTime;
+}
+
+void CoopWeightedFairPolicy::beginPass(const CoopTaskBase* first) noexcept
+{
+    if (first->virtualTime > virtualClock) virtualClock = first->virtualTime;
+}
+
+bool CoopWeightedFairPolicy::admits(const CoopTaskBase* task) const noexcept
+{
+    return task->virtualTime <= virtualClock + slice;
+}
+
+void CoopWeightedFairPolicy::running(CoopTaskBase* task) noexcept
+{
+    (void)task;
+#if defined(ARDUINO)
+    runStart = micros();
+#else
+    runStart = CoopTaskBase::now();
+#endif
+}
+
+void CoopWeightedFairPolicy::ran(CoopTaskBase* task) noexcept
+{
+#if defined(ARDUINO)
+    const uint64_t runTime = static_cast<uint32_t>(micros() - runStart);
+#else
+    const uint64_t runTime = CoopTaskBase::now() - runStart;
+#endif
+    // every run is charged, such that a task that runs in no time cannot keep its place
+    const uint64_t charge = (runTime << WEIGHTSHIFT) / task->weight();
+    task->virtualTime += charge ? charge : 1;
+}
@@ -0,0 +1,110 @@
+/*
+CoopSchedulingPolicy.h - Implementation of scheduling policies for cooperative scheduling tasks
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __CoopSchedulingPolicy_h
+#define __CoopSchedulingPolicy_h
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <cstdint>
+#endif
+
+class CoopTaskBase;
+
+/// The order in which a scheduler in ready queue mode runs its ready tasks.
+/// The ready tasks are kept sorted by before(), a scheduling pass runs them from the first one on,
+/// as long as admits() accepts the next one, and each task at most once. Tasks that are readied
+/// during the pass join it in order, such that a task that precedes the others does not wait for
+/// the remainder of the pass.
+/// A policy instance keeps the state of a single scheduler, see CoopTaskBase::useSchedulingPolicy().
+/// All functions are called from the thread that runs the CoopTasks of that scheduler.
+class CoopSchedulingPolicy
+{
+public:
+    virtual ~CoopSchedulingPolicy() = default;
+
+    /// Called when the task has been readied, before it is sorted into the ready tasks.
+    virtual void readied(CoopTaskBase* task) noexcept { (void)task; }
+    /// @returns: true if task a runs before task b. Tasks of which neither runs before the other
+    /// run in FIFO order.
+    virtual bool before(const CoopTaskBase* a, const CoopTaskBase* b) const noexcept = 0;
+    /// Called when a scheduling pass begins.
+    /// @param first the first of the ready tasks.
+    virtual void beginPass(const CoopTaskBase* first) noexcept { (void)first; }
+    /// @param task the first of the ready tasks that has not yet run in this pass.
+    /// @returns: true if task runs in this pass, false ends the pass.
+    virtual bool admits(const CoopTaskBase* task) const noexcept { (void)task; return true; }
+    /// Called right before the task runs.
+    virtual void running(CoopTaskBase* task) noexcept { (void)task; }
+    /// Called right after the task has run, even if it has exited.
+    virtual void ran(CoopTaskBase* task) noexcept { (void)task; }
+};
+
+/// Strict fixed priority scheduling, the default policy. A pass only runs the ready tasks of
+/// the highest CoopTaskBase::priority() among them, in FIFO order. Tasks of lower priority run
+/// in the first pass that has no ready task of higher priority, such that they starve as long
+/// as those keep being ready. With equal priorities, this is round-robin scheduling.
+class CoopFixedPriorityPolicy : public CoopSchedulingPolicy
+{
+public:
+    bool before(const CoopTaskBase* a, const CoopTaskBase* b) const noexcept override;
+    void beginPass(const CoopTaskBase* first) noexcept override;
+    bool admits(const CoopTaskBase* task) const noexcept override;
+
+protected:
+    uint8_t passPriority = 0;
+};
+
+/// Weighted fair queuing. Each task is charged the time it runs, divided by its
+/// CoopTaskBase::weight(), to its virtual time. The ready tasks run in the order of their
+/// virtual time, and a pass only runs those that are at most the slice behind the first one,
+/// such that over time, each busy task gets a share of the CPU in proportion to its weight.
+/// A task that gets readied after sleeping or being delayed starts at the virtual time of the
+/// current pass, it neither accumulates credit while it is not ready, nor waits for the busy tasks.
+/// CoopTaskBase::priority() is ignored, therefore the owner of a CoopMutex gains nothing from the
+/// priority it inherits, priority inheritance only applies with CoopFixedPriorityPolicy.
+class CoopWeightedFairPolicy : public CoopSchedulingPolicy
+{
+public:
+    /// @param slice_us the weighted run time, measured in microseconds, by which the tasks of a pass
+    /// may be behind the first one in virtual time.
+    explicit CoopWeightedFairPolicy(uint32_t slice_us = 1000);
+
+    void readied(CoopTaskBase* task) noexcept override;
+    bool before(const CoopTaskBase* a, const CoopTaskBase* b) const noexcept override;
+    void beginPass(const CoopTaskBase* first) noexcept override;
+    bool admits(const CoopTaskBase* task) const noexcept override;
+    void running(CoopTaskBase* task) noexcept override;
+    void ran(CoopTaskBase* task) noexcept override;
+
+protected:
+    // run times are scaled up by WEIGHTSHIFT bits before they are divided by the weight
+    static constexpr unsigned WEIGHTSHIFT = 8;
+    uint64_t slice;
+    // the virtual time of the first task of the current pass
+    uint64_t virtualClock = 0;
+#if defined(ARDUINO)
+    uint32_t runStart = 0;
+#else
+    uint64_t runStart = 0;
+#endif
+};
+
+#endif // __CoopSchedulingPolicy_h
@@ -37,12 +37,12 @@ public:
 #endif
 
 #ifndef ARDUINO
-#include <chrono>
 namespace
 {
+    // the clock of CoopTask delays, differences of the truncated value are wrap-around safe
     uint32_t millis()
     {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        return static_cast<uint32_t>(CoopTaskBase::now() / 1000000UL);
     }
 }
 #endif
@@ -73,9 +73,11 @@ bool CoopSemaphore::_wait(const bool withDeadline, const uint32_t ms)
         if (withDeadline) expired = millis() - start;
         if (!(selfFirst && valOnEntry))
         {
-            if (pendingTasks.push(self))
+            if (pendingTasks.push_back(self))
             {
-                if (!withDeadline) self->sleep(true);
+                // a timed sleep is ended by post() like the untimed one, or by the deadline
+                if (withDeadline) self->sleepFor(expired < ms ? ms - expired : 0);
+                else self->sleep(true);
             }
             else
             {
@@ -88,19 +90,19 @@ bool CoopSemaphore::_wait(const bool withDeadline, const uint32_t ms)
         bool selfSuccess = false;
         for (;;)
         {
-            if (pendingTasks.available())
+            if (!pendingTasks.empty())
             {
 #if !defined(ESP32) && defined(ARDUINO)
                 {
                     InterruptLock lock;
                     pendingTask = pendingTask0.load();
-                    if (fwd || !pendingTask) pendingTask0.store(pendingTasks.pop());
+                    if (fwd || !pendingTask) pendingTask0.store(pendingTasks.pop_front());
                 }
 #else
                 pendingTask = nullptr;
                 bool exchd = false;
-                while ((fwd || !pendingTask) && !(exchd = pendingTask0.compare_exchange_weak(pendingTask, pendingTasks.peek()))) {}
-                if (exchd) pendingTasks.pop();
+                while ((fwd || !pendingTask) && !(exchd = pendingTask0.compare_exchange_weak(pendingTask, pendingTasks.front()))) {}
+                if (exchd) pendingTasks.pop_front();
 #endif
             }
             else
@@ -128,14 +130,15 @@ bool CoopSemaphore::_wait(const bool withDeadline, const uint32_t ms)
             if (selfFirst)
             {
                 selfFirst = false;
-                if (!withDeadline) self->sleep(false);
+                self->sleep(false);
                 selfSuccess = true;
             }
             else if (pendingTask == self)
             {
                 if (!selfSuccess)
                 {
-                    if (!withDeadline) self->sleep(false);
+                    self->sleep(false);
+                    pendingTasks.remove(self);
                     return true;
                 }
                 if (!stop) continue;
@@ -153,6 +156,8 @@ bool CoopSemaphore::_wait(const bool withDeadline, const uint32_t ms)
         }
         if (selfSuccess)
         {
+            // a waiter with deadline can succeed on retry while still in the wait list, or in pendingTask0
+            unlinkPending(self);
             return true;
         }
         if (valOnEntry)
@@ -169,31 +174,30 @@ bool CoopSemaphore::_wait(const bool withDeadline, const uint32_t ms)
         {
             if (expired >= ms)
             {
-                pendingTasks.for_each_rev_requeue(notIsSelfTask);
-#if !defined(ESP32) && defined(ARDUINO)
-                {
-                    InterruptLock lock;
-                    pendingTask = pendingTask0.load();
-                    if (pendingTask == self) pendingTask0.store(pendingTasks.available() ? pendingTasks.pop() : nullptr);
-                }
-#else
-                bool exchd = false;
-                pendingTask = self;
-                while ((pendingTask == self) && !(exchd = pendingTask0.compare_exchange_weak(pendingTask, pendingTasks.available() ? pendingTasks.peek() : nullptr))) {}
-                if (exchd && pendingTasks.available()) pendingTasks.pop();
-#endif
+                self->sleep(false);
+                unlinkPending(self);
                 return false;
             }
-            CoopTaskBase::delay(ms - expired);
-        }
-        else
-        {
-            CoopTaskBase::yield();
         }
+        CoopTaskBase::yield();
         selfFirst = true;
     }
 }
 
+void CoopSemaphore::unlinkPending(CoopTaskBase* self)
+{
+    pendingTasks.remove(self);
+#if !defined(ESP32) && defined(ARDUINO)
+    InterruptLock lock;
+    if (pendingTask0.load() == self) pendingTask0.store(pendingTasks.pop_front());
+#else
+    bool exchd = false;
+    CoopTaskBase* pendingTask = self;
+    while ((pendingTask == self) && !(exchd = pendingTask0.compare_exchange_weak(pendingTask, pendingTasks.front()))) {}
+    if (exchd) pendingTasks.pop_front();
+#endif
+}
+
 bool IRAM_ATTR CoopSemaphore::post()
 {
     CoopTaskBase* pendingTask;
@@ -214,6 +218,74 @@ bool IRAM_ATTR CoopSemaphore::post()
     return pendingTask->scheduleTask(true);
 }
 
+bool CoopSemaphore::post(unsigned count)
+{
+    if (!count) return true;
+    CoopTaskBase* pendingTask;
+#if !defined(ESP32) && defined(ARDUINO)
+    {
+        InterruptLock lock;
+        unsigned val = value.load();
+        value.store(val + count);
+        pendingTask = pendingTask0.load();
+        if (pendingTask) pendingTask0.store(nullptr);
+    }
+#else
+    unsigned val = 0;
+    while (!value.compare_exchange_weak(val, val + count)) {}
+    pendingTask = pendingTask0.exchange(nullptr);
+#endif
+    return wakePending(pendingTask, count);
+}
+
+bool CoopSemaphore::broadcast()
+{
+    CoopTaskBase* pendingTask;
+#if !defined(ESP32) && defined(ARDUINO)
+    {
+        InterruptLock lock;
+        pendingTask = pendingTask0.load();
+        if (pendingTask) pendingTask0.store(nullptr);
+    }
+#else
+    pendingTask = pendingTask0.exchange(nullptr);
+#endif
+    const unsigned count = static_cast<unsigned>(pendingTasks.size()) + (pendingTask ? 1 : 0);
+    if (!count) return true;
+#if !defined(ESP32) && defined(ARDUINO)
+    {
+        InterruptLock lock;
+        unsigned val = value.load();
+        value.store(val + count);
+    }
+#else
+    unsigned val = 0;
+    while (!value.compare_exchange_weak(val, val + count)) {}
+#endif
+    return wakePending(pendingTask, count);
+}
+
+bool CoopSemaphore::wakePending(CoopTaskBase* pendingTask, unsigned count)
+{
+    bool success = true;
+    // readies the tasks together when it goes out of scope
+    CoopTaskBase::WakeBatch batch;
+    if (pendingTask)
+    {
+        --count;
+        if (pendingTask->suspended()) success = batch.add(pendingTask);
+    }
+    // the woken tasks find pendingTask0 empty, and the first of them to run
+    // moves the head of the remaining pendingTasks there, for the next post().
+    while (count && !pendingTasks.empty())
+    {
+        --count;
+        pendingTask = pendingTasks.pop_front();
+        if (pendingTask->suspended()) success = batch.add(pendingTask) && success;
+    }
+    return success;
+}
+
 bool CoopSemaphore::setval(unsigned newVal)
 {
     CoopTaskBase* pendingTask = nullptr;
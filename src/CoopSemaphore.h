@@ -21,58 +21,72 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define __CoopSemaphore_h
 
 #include "CoopTaskBase.h"
-#include "circular_queue/circular_queue.h"
+#include "CoopWaitList.h"
 
 /// A semaphore that is safe to use from CoopTasks.
 /// Only post() is safe to use from interrupt service routines,
-/// or concurrent OS threads that must synchronized with the singled thread running CoopTasks.
+/// or concurrent OS threads that must synchronized with the single thread running CoopTasks.
+/// With a scheduler per thread, all tasks that wait() on the same semaphore must belong to the same
+/// scheduler, because the list of waiting tasks, a CoopWaitList, is not synchronized.
 class CoopSemaphore
 {
 protected:
     std::atomic<unsigned> value;
     std::atomic<CoopTaskBase*> pendingTask0;
-    circular_queue<CoopTaskBase*> pendingTasks;
-
-    // capture-less functions for iterators.
-    static void awakeAndSchedule(CoopTaskBase*&& task)
-    {
-        task->scheduleTask(true);
-    }
-    static bool notIsSelfTask(CoopTaskBase*& task)
-    {
-        return CoopTaskBase::self() != task;
-    }
+    CoopWaitList pendingTasks;
 
     /// @param withDeadline true: the ms parameter specifies the relative timeout for a successful
     /// aquisition of the semaphore.
     /// false: there is no deadline, the ms parameter is disregarded.
     /// @param ms the relative timeout measured in milliseconds.
     /// @returns: true if it sucessfully acquired the semaphore, either immediately or after sleeping.
-    /// false if the deadline expired, or the maximum number of pending tasks is exceeded.
+    /// false if the deadline expired.
     bool _wait(const bool withDeadline = false, const uint32_t ms = 0);
 
+    /// Removes self from the waiting tasks, including pendingTask0, which it may still occupy
+    /// when it stops waiting on its own, and moves the next waiting task there.
+    void unlinkPending(CoopTaskBase* self);
+
+    /// Wakes up pendingTask, and the next ones from pendingTasks, up to count tasks in total.
+    /// @returns: false if scheduling any of the woken tasks failed, otherwise true.
+    bool wakePending(CoopTaskBase* pendingTask, unsigned count);
+
 public:
     /// @param val the initial value of the semaphore.
-    /// @param maxPending the maximum supported number of concurrently waiting tasks.
-    CoopSemaphore(unsigned val, size_t maxPending = 10) : value(val), pendingTask0(nullptr), pendingTasks(maxPending) {}
+    /// @param maxPending ignored, the number of concurrently waiting tasks is unlimited; kept for source compatibility.
+    CoopSemaphore(unsigned val, size_t maxPending = 10) : value(val), pendingTask0(nullptr)
+    {
+        (void)maxPending;
+    }
     CoopSemaphore(const CoopSemaphore&) = delete;
     CoopSemaphore& operator=(const CoopSemaphore&) = delete;
     ~CoopSemaphore()
     {
         // wake up all queued tasks
-        pendingTasks.for_each(awakeAndSchedule);
+        while (auto task = pendingTasks.pop_front()) task->scheduleTask(true);
     }
 
     /// post() is the only operation that is allowed from an interrupt service routine,
-    /// or a concurrent OS thread that is synchronized with the singled thread running CoopTasks.
+    /// or a concurrent OS thread that is synchronized with the single thread running CoopTasks.
     bool IRAM_ATTR post();
 
+    /// Increments the semaphore by count, and wakes up to count waiting tasks at once,
+    /// instead of each woken task waking up the next one on its turn.
+    /// Unlike post(), this is only allowed from the thread running CoopTasks.
+    /// @returns: false if scheduling any of the woken tasks failed, otherwise true.
+    bool post(unsigned count);
+
+    /// Wakes up all waiting tasks at once, incrementing the semaphore by their number,
+    /// such that each of them acquires it.
+    /// Unlike post(), this is only allowed from the thread running CoopTasks.
+    /// @returns: false if scheduling any of the woken tasks failed, otherwise true.
+    bool broadcast();
+
     /// @param newVal: the semaphore is immediately set to the specified value. if newVal is greater
     /// than the current semaphore value, the behavior is identical to as many post operations.
     bool setval(unsigned newVal);
 
     /// @returns: true if it sucessfully acquired the semaphore, either immediately or after sleeping.
-    /// false if the maximum number of pending tasks is exceeded.
     bool wait()
     {
         return _wait();
@@ -80,7 +94,7 @@ public:
 
     /// @param ms the relative timeout, measured in milliseconds, for a successful aquisition of the semaphore.
     /// @returns: true if it sucessfully acquired the semaphore, either immediately or after sleeping.
-    /// false if the deadline expired, or the maximum number of pending tasks is exceeded.
+    /// false if the deadline expired.
     bool wait(uint32_t ms)
     {
         return _wait(true, ms);
@@ -18,10 +18,26 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include "CoopTaskBase.h"
+#include "CoopWaitList.h"
 #ifdef ARDUINO
 #include <alloca.h>
 #else
 #include <chrono>
+#include <cstdio>
+#endif
+#if defined(__linux__) && !defined(ARDUINO)
+#include <time.h>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef PSTR
+#define PSTR(s) (s)
 #endif
 
 #if defined(ESP8266)
@@ -114,27 +130,87 @@ extern "C" {
 #endif // ESP32_FREERTOS
 }
 
-std::array< std::atomic<CoopTaskBase* >, CoopTaskBase::MAXNUMBERCOOPTASKS + 1> CoopTaskBase::runnableTasks {};
+#if defined(ARDUINO)
+CoopTaskBase::RunnableTasks<CoopTaskBase> CoopTaskBase::runnableTasks {};
+#else
+CoopTaskBase::RunnableTasks<CoopTaskBase> CoopTaskBase::runnableTasks;
+std::atomic<size_t> CoopTaskBase::runnableTasksFree(0);
+#endif
 std::atomic<size_t> CoopTaskBase::runnableTasksCount(0);
 
+#if defined(ARDUINO)
 CoopTaskBase* CoopTaskBase::current = nullptr;
+#else
+thread_local CoopTaskBase* CoopTaskBase::current = nullptr;
+#endif
 
-#ifndef ARDUINO
-namespace
+bool CoopTaskBase::usingReadyQueue = false;
+#if defined(__linux__) && !defined(ARDUINO)
+bool CoopTaskBase::usingBlockingIdle = false;
+std::atomic<uint32_t> CoopTaskBase::idleWakeups(0);
+std::atomic<uint32_t> CoopTaskBase::idleWaiters(0);
+std::atomic<uint32_t> CoopTaskBase::idleSleepers(0);
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+
+void CoopTaskBase::notifyIdle()
 {
-    uint32_t millis()
+    // the fences of notifyIdle() and beginIdle() order the scheduling of the task and the check of idleWaiters
+    // against the count of the waiter and its check of the tasks, such that either sees the other.
+    // Without waiting threads, scheduleTask() never writes to the shared futex word
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!idleWaiters.load(std::memory_order_relaxed)) return;
+    idleWakeups.fetch_add(1);
+    // a sleeper increments idleSleepers before checking idleWakeups, so either sees the other
+    if (idleSleepers.load())
     {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&idleWakeups), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
     }
-    uint32_t micros()
-    {
-        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    }
-    void delayMicroseconds(uint32_t us)
+}
+
+uint32_t CoopTaskBase::beginIdle()
+{
+    idleWaiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return idleWakeups.load();
+}
+
+void CoopTaskBase::waitIdle(uint32_t epoch, const struct timespec* until)
+{
+    idleSleepers.fetch_add(1);
+    while (idleWakeups.load() == epoch)
     {
-        const uint32_t start = micros();
-        while (micros() - start < us) {}
+        // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline
+        if (syscall(SYS_futex, reinterpret_cast<uint32_t*>(&idleWakeups), FUTEX_WAIT_BITSET_PRIVATE, epoch,
+            until, nullptr, FUTEX_BITSET_MATCH_ANY) < 0 && errno == ETIMEDOUT) break;
     }
+    idleSleepers.fetch_sub(1);
+}
+#endif
+#if !defined(ARDUINO)
+CoopTaskBase::ClockSource CoopTaskBase::clockSource = CoopTaskBase::steadyClock;
+std::atomic<uint64_t> CoopManualClock::time(0);
+
+uint64_t CoopTaskBase::steadyClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+#if defined(ARDUINO)
+CoopTaskBase::Scheduler CoopTaskBase::localScheduler;
+#else
+thread_local CoopTaskBase::Scheduler* CoopTaskBase::localScheduler = nullptr;
+std::array<std::atomic<CoopTaskBase::Scheduler*>, CoopTaskBase::MAXNUMBERSCHEDULERS> CoopTaskBase::schedulers {};
+bool CoopTaskBase::usingWorkStealing = false;
+#endif
+
+#ifndef ARDUINO
+namespace
+{
+#if defined(__linux__)
+    // an idle runCoopTasks() sleeps until this many microseconds before the next deadline,
+    // larger than the default timer slack of Linux threads
+    constexpr uint32_t IDLE_SPIN_US = 100;
+#endif
 }
 #elif defined(ESP8266) || defined(ESP32)
 namespace
@@ -149,10 +225,11 @@ bool CoopTaskBase::usingBuiltinScheduler = false;
 bool CoopTaskBase::rescheduleTask(uint32_t repeat_us)
 {
     auto stat = run();
-    if (sleeping()) return false;
+    if (sleeping() && !delayed()) return false;
     switch (stat)
     {
     case -1: // exited.
+        recycle();
         return false;
         break;
     case 0: // runnable.
@@ -174,6 +251,8 @@ bool CoopTaskBase::rescheduleTask(uint32_t repeat_us)
 }
 #endif
 
+#if defined(ARDUINO)
+
 bool IRAM_ATTR CoopTaskBase::enrollRunnable()
 {
     bool enrolled = false;
@@ -257,6 +336,548 @@ void CoopTaskBase::delistRunnable()
 #endif
 }
 
+#else
+
+bool CoopTaskBase::enrollRunnable()
+{
+    if (NOTENROLLED != runnableIndex.load()) return true;
+    auto start = runnableTasksFree.load();
+    auto i = start;
+    for (;; ++i)
+    {
+        if (i >= runnableTasks.size() && !runnableTasks.grow() && i >= runnableTasks.size()) return false;
+        CoopTaskBase* cmpTo = nullptr;
+        if (runnableTasks[i].compare_exchange_strong(cmpTo, this)) break;
+    }
+    auto index = NOTENROLLED;
+    if (!runnableIndex.compare_exchange_strong(index, i))
+    {
+        // enrolled concurrently into another slot
+        runnableTasks[i].store(nullptr);
+        return true;
+    }
+    ++runnableTasksCount;
+    // slots from start up to i were found occupied, unless one was delisted in the meantime
+    runnableTasksFree.compare_exchange_strong(start, i + 1);
+    return true;
+}
+
+void CoopTaskBase::delistRunnable()
+{
+    const auto i = runnableIndex.exchange(NOTENROLLED);
+    if (NOTENROLLED == i) return;
+    runnableTasks[i].store(nullptr);
+    --runnableTasksCount;
+    auto free = runnableTasksFree.load();
+    while (free > i && !runnableTasksFree.compare_exchange_weak(free, i)) {}
+}
+
+#endif
+
+#if defined(ARDUINO)
+
+CoopTaskBase::Scheduler& CoopTaskBase::threadScheduler()
+{
+    return localScheduler;
+}
+
+#else
+
+CoopTaskBase::Scheduler& CoopTaskBase::threadScheduler()
+{
+    if (!localScheduler)
+    {
+        // never freed, tasks and other threads may still refer to it after this thread ends
+        localScheduler = new Scheduler();
+        for (auto& slot : schedulers)
+        {
+            Scheduler* cmpTo = nullptr;
+            if (slot.compare_exchange_strong(cmpTo, localScheduler)) break;
+        }
+    }
+    return *localScheduler;
+}
+
+CoopTaskBase::Scheduler& CoopTaskBase::unhomedScheduler()
+{
+    // never runs, only its readyTasks are used
+    static Scheduler unhomed;
+    return unhomed;
+}
+
+CoopTaskBase::Scheduler& CoopTaskBase::homeScheduler() noexcept
+{
+    auto home = scheduler.load(std::memory_order_acquire);
+    if (!home)
+    {
+        // a thread that does not run CoopTasks leaves the task to the next scheduling pass on any thread
+        home = localScheduler ? localScheduler : &unhomedScheduler();
+        Scheduler* cmpTo = nullptr;
+        if (!scheduler.compare_exchange_strong(cmpTo, home)) home = cmpTo;
+    }
+    return *home;
+}
+
+void CoopTaskBase::adoptUnhomedTasks(Scheduler& sched)
+{
+    auto& unhomed = unhomedScheduler();
+    if (!unhomed.readyTasks.load(std::memory_order_relaxed)) return;
+    unhomed.acquire();
+    auto head = unhomed.readyTasks.exchange(nullptr, std::memory_order_acquire);
+    CoopTaskBase* last = head;
+    for (auto task = head; task; task = task->readyNext)
+    {
+        task->scheduler.store(&sched, std::memory_order_release);
+        last = task;
+    }
+    if (head) sched.push(head, last);
+    unhomed.release();
+}
+
+bool CoopTaskBase::Scheduler::unlinkReady(CoopTaskBase* task)
+{
+    // pushes are lock-free, take the whole list and push back the others
+    auto head = readyTasks.exchange(nullptr, std::memory_order_acquire);
+    bool found = false;
+    CoopTaskBase* prev = nullptr;
+    for (auto next = head; next; prev = next, next = next->readyNext)
+    {
+        if (next != task) continue;
+        if (prev) prev->readyNext = task->readyNext;
+        else head = task->readyNext;
+        task->readyNext = nullptr;
+        found = true;
+        break;
+    }
+    if (head)
+    {
+        auto last = head;
+        while (last->readyNext) last = last->readyNext;
+        push(head, last);
+    }
+    return found;
+}
+
+bool CoopTaskBase::stealReadyTasks()
+{
+    if (!usingWorkStealing) return false;
+    auto& thief = threadScheduler();
+    for (auto& slot : schedulers)
+    {
+        auto victim = slot.load();
+        if (!victim) break;
+        if (victim == &thief) continue;
+        // the victim's lock keeps the tasks from being deleted while they are detached from its list
+        victim->acquire();
+        auto head = victim->readyTasks.exchange(nullptr, std::memory_order_acquire);
+        CoopTaskBase* stolen = nullptr;
+        CoopTaskBase* stolenLast = nullptr;
+        CoopTaskBase* kept = nullptr;
+        CoopTaskBase* keptLast = nullptr;
+        bool steal = true;
+        while (head)
+        {
+            auto task = head;
+            head = task->readyNext;
+            // leave every other unpinned task to the victim
+            if (!task->pinned.load() && (steal = !steal))
+            {
+                // a task moves at most once
+                task->pinned.store(true);
+                task->scheduler.store(&thief, std::memory_order_release);
+                task->readyNext = stolen;
+                stolen = task;
+                if (!stolenLast) stolenLast = task;
+            }
+            else
+            {
+                task->readyNext = kept;
+                kept = task;
+                if (!keptLast) keptLast = task;
+            }
+        }
+        if (kept) victim->push(kept, keptLast);
+        // pushed before the lock is released, a task that is deleted meanwhile is found on the thief's list
+        if (stolen) thief.push(stolen, stolenLast);
+        victim->release();
+        if (stolen) return true;
+    }
+    return false;
+}
+
+#endif
+
+void IRAM_ATTR CoopTaskBase::Scheduler::push(CoopTaskBase* first, CoopTaskBase* last)
+{
+#if !defined(ESP32) && defined(ARDUINO)
+    InterruptLock lock;
+    last->readyNext = readyTasks.load();
+    readyTasks.store(first);
+#else
+    auto head = readyTasks.load(std::memory_order_relaxed);
+    do
+    {
+        last->readyNext = head;
+    } while (!readyTasks.compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+#endif
+}
+
+bool CoopTaskBase::Scheduler::takeReady()
+{
+    CoopTaskBase* head;
+#if !defined(ESP32) && defined(ARDUINO)
+    {
+        InterruptLock lock;
+        head = readyTasks.load();
+        readyTasks.store(nullptr);
+    }
+#else
+    // skip the exchange if the list is empty, tasks pushed meanwhile are taken the next time
+    head = readyTasks.load(std::memory_order_relaxed) ? readyTasks.exchange(nullptr, std::memory_order_acquire) : nullptr;
+#endif
+    // readyTasks is LIFO, reverse it to insert into the pass in FIFO order
+    CoopTaskBase* first = nullptr;
+    while (head)
+    {
+        auto next = head->readyNext;
+        head->readyNext = first;
+        first = head;
+        head = next;
+    }
+    while (first)
+    {
+        auto task = first;
+        first = task->readyNext;
+        policy->readied(task);
+        insertPass(task);
+    }
+    return readyPass;
+}
+
+void CoopTaskBase::Scheduler::insertPass(CoopTaskBase* task)
+{
+    // unless it runs before the last one, the task is appended
+    if (!readyPassTail || !policy->before(task, readyPassTail))
+    {
+        task->readyNext = nullptr;
+        if (readyPassTail) readyPassTail->readyNext = task;
+        else readyPass = task;
+        readyPassTail = task;
+        return;
+    }
+    CoopTaskBase* prev = nullptr;
+    auto next = readyPass;
+    while (!policy->before(task, next))
+    {
+        prev = next;
+        next = next->readyNext;
+    }
+    task->readyNext = next;
+    if (prev) prev->readyNext = task;
+    else readyPass = task;
+}
+
+bool CoopTaskBase::Scheduler::unlinkPass(CoopTaskBase* task)
+{
+    // take the concurrently readied tasks into the pass, where the task can safely be unlinked
+    takeReady();
+    CoopTaskBase* prev = nullptr;
+    for (auto next = readyPass; next; prev = next, next = next->readyNext)
+    {
+        if (next != task) continue;
+        if (prev) prev->readyNext = task->readyNext;
+        else readyPass = task->readyNext;
+        if (readyPassTail == task) readyPassTail = prev;
+        task->readyNext = nullptr;
+        return true;
+    }
+    return false;
+}
+
+void IRAM_ATTR CoopTaskBase::enqueueReady()
+{
+    if (!usingReadyQueue) return;
+#if !defined(ESP32) && defined(ARDUINO)
+    {
+        InterruptLock lock;
+        if (readyQueued.load()) return;
+        readyQueued.store(true);
+    }
+#else
+    if (readyQueued.exchange(true)) return;
+#endif
+    homeScheduler().push(this, this);
+}
+
+void CoopTaskBase::enqueuePass()
+{
+    if (!usingReadyQueue) return;
+#if !defined(ESP32) && defined(ARDUINO)
+    {
+        InterruptLock lock;
+        if (readyQueued.load()) return;
+        readyQueued.store(true);
+    }
+#else
+    // readied concurrently, the task is on the ready list already
+    if (readyQueued.exchange(true)) return;
+#endif
+    auto& sched = homeScheduler();
+    sched.policy->readied(this);
+    sched.insertPass(this);
+}
+
+bool IRAM_ATTR CoopTaskBase::WakeBatch::add(CoopTaskBase* task)
+{
+#if defined(ARDUINO)
+    return task->scheduleTask(true);
+#else
+    if (!*task || !task->enrollRunnable()) return false;
+    task->sleep(false);
+    notify = true;
+    if (!usingReadyQueue || task->readyQueued.exchange(true)) return true;
+    auto& home = task->homeScheduler();
+    if (first && &home != sched)
+    {
+        sched->push(first, last);
+        first = nullptr;
+    }
+    sched = &home;
+    task->readyNext = first;
+    if (!first) last = task;
+    first = task;
+    return true;
+#endif
+}
+
+void IRAM_ATTR CoopTaskBase::WakeBatch::flush()
+{
+#if !defined(ARDUINO)
+    if (first)
+    {
+        sched->push(first, last);
+        first = nullptr;
+    }
+    if (notify)
+    {
+        notify = false;
+#if defined(__linux__)
+        notifyIdle();
+#endif
+    }
+#endif
+}
+
+bool CoopTaskBase::beginReadyPass()
+{
+    auto& sched = threadScheduler();
+#if !defined(ARDUINO)
+    adoptUnhomedTasks(sched);
+#endif
+    ++sched.pass;
+    if (!sched.takeReady()) return false;
+    sched.policy->beginPass(sched.readyPass);
+    return true;
+}
+
+void CoopTaskBase::useSchedulingPolicy(CoopSchedulingPolicy* policy)
+{
+    auto& sched = threadScheduler();
+    sched.policy = policy ? policy : &sched.defaultPolicy;
+    auto task = sched.readyPass;
+    sched.readyPass = nullptr;
+    sched.readyPassTail = nullptr;
+    while (task)
+    {
+        auto next = task->readyNext;
+        sched.policy->readied(task);
+        sched.insertPass(task);
+        task = next;
+    }
+}
+
+CoopTaskBase* CoopTaskBase::nextReadyTask()
+{
+    auto& sched = threadScheduler();
+    // tasks that get ready during the pass join it, instead of waiting for the next one
+    readyExpiredTasks();
+    if (sched.readyTasks.load()) sched.takeReady();
+    auto task = sched.readyPass;
+    if (task && (task->lastPass == sched.pass || !sched.policy->admits(task))) return nullptr;
+    if (task)
+    {
+        sched.readyPass = task->readyNext;
+        if (!sched.readyPass) sched.readyPassTail = nullptr;
+        task->readyNext = nullptr;
+#if !defined(ARDUINO)
+        if (!task->pinned.load(std::memory_order_relaxed)) task->pinned.store(true, std::memory_order_release);
+#endif
+        // concurrent wakers exchange the flag, an ordered store is enough
+        task->readyQueued.store(false, std::memory_order_release);
+        // a woken up task may still wait on its deadline
+        task->dequeueDelayed();
+        task->lastPass = sched.pass;
+        sched.policy->running(task);
+    }
+    return task;
+}
+
+void CoopTaskBase::dequeueReady()
+{
+    if (!readyQueued.load()) return;
+#if defined(ARDUINO)
+    if (homeScheduler().unlinkPass(this)) readyQueued.store(false);
+#else
+    for (;;)
+    {
+        auto home = scheduler.load(std::memory_order_acquire);
+        if (!home) return;
+        home->acquire();
+        // stolen or adopted before the lock was taken, the task is on the list of its new scheduler
+        if (scheduler.load(std::memory_order_acquire) != home)
+        {
+            home->release();
+            continue;
+        }
+        // no other thread can take the task any more
+        pinned.store(true);
+        // the pass is only accessible on the scheduler's own thread
+        const bool found = home == localScheduler ? home->unlinkPass(this) : home->unlinkReady(this);
+        home->release();
+        if (found) readyQueued.store(false);
+        return;
+    }
+#endif
+}
+
+void CoopTaskBase::requeueReady() noexcept
+{
+    if (!usingReadyQueue || !readyQueued.load()) return;
+    auto& sched = homeScheduler();
+#if !defined(ARDUINO)
+    // only the thread of the scheduler reorders its pass, else the task moves when it is readied next
+    if (&sched != localScheduler) return;
+#endif
+    if (sched.unlinkPass(this)) sched.insertPass(this);
+}
+
+void CoopTaskBase::setPriority(uint8_t prio) noexcept
+{
+    const auto before = priority();
+    taskPriority = prio;
+    if (priority() != before) requeueReady();
+}
+
+void CoopTaskBase::inheritPriority(uint8_t prio) noexcept
+{
+    const auto before = priority();
+    inheritedPriority = prio;
+    if (priority() != before) requeueReady();
+}
+
+void CoopTaskBase::Scheduler::siftUpDelayed(size_t pos)
+{
+    auto task = delayedTasks[pos];
+    while (pos)
+    {
+        const size_t parent = (pos - 1) / 2;
+        if (!deadlineBefore(task, delayedTasks[parent])) break;
+        delayedTasks[pos] = delayedTasks[parent];
+        delayedTasks[pos]->delayedIndex = pos;
+        pos = parent;
+    }
+    delayedTasks[pos] = task;
+    task->delayedIndex = pos;
+}
+
+void CoopTaskBase::Scheduler::siftDownDelayed(size_t pos)
+{
+    auto task = delayedTasks[pos];
+    for (;;)
+    {
+        size_t child = 2 * pos + 1;
+        if (child >= delayedTasksCount) break;
+        if (child + 1 < delayedTasksCount && deadlineBefore(delayedTasks[child + 1], delayedTasks[child])) ++child;
+        if (!deadlineBefore(delayedTasks[child], task)) break;
+        delayedTasks[pos] = delayedTasks[child];
+        delayedTasks[pos]->delayedIndex = pos;
+        pos = child;
+    }
+    delayedTasks[pos] = task;
+    task->delayedIndex = pos;
+}
+
+void CoopTaskBase::enqueueDelayed(uint32_t delay)
+{
+#if defined(ARDUINO)
+    // longer delays are filed at DELAY_MAXINT microseconds, run() then returns the remainder
+    uint32_t us = !delay_ms ? delay : delay >= DELAY_MAXINT / 1000UL ? DELAY_MAXINT : delay * 1000UL;
+    if (us > DELAY_MAXINT) us = DELAY_MAXINT;
+    deadline = micros() + us;
+#else
+    (void)delay;
+#endif
+    auto& sched = homeScheduler();
+    if (NOTDELAYED != delayedIndex)
+    {
+        // re-filed with a new deadline
+        sched.siftUpDelayed(delayedIndex);
+        sched.siftDownDelayed(delayedIndex);
+        return;
+    }
+#if !defined(ARDUINO)
+    if (sched.delayedTasksCount == sched.delayedTasks.size()) sched.delayedTasks.push_back(this);
+#endif
+    sched.delayedTasks[sched.delayedTasksCount] = this;
+    sched.siftUpDelayed(sched.delayedTasksCount++);
+}
+
+void CoopTaskBase::dequeueDelayed()
+{
+    if (NOTDELAYED == delayedIndex) return;
+    auto& sched = homeScheduler();
+    const size_t pos = delayedIndex;
+    delayedIndex = NOTDELAYED;
+    if (pos == --sched.delayedTasksCount) return;
+    sched.delayedTasks[pos] = sched.delayedTasks[sched.delayedTasksCount];
+    sched.siftUpDelayed(pos);
+    sched.siftDownDelayed(sched.delayedTasks[pos]->delayedIndex);
+}
+
+void CoopTaskBase::readyExpiredTasks()
+{
+    auto& sched = threadScheduler();
+    if (!sched.delayedTasksCount) return;
+#if defined(ARDUINO)
+    const uint32_t now = micros();
+    while (sched.delayedTasksCount && static_cast<int32_t>(sched.delayedTasks[0]->deadline - now) <= 0)
+#else
+    const uint64_t now = CoopTaskBase::now();
+    while (sched.delayedTasksCount && sched.delayedTasks[0]->deadline <= now)
+#endif
+    {
+        auto task = sched.delayedTasks[0];
+        task->dequeueDelayed();
+        task->enqueuePass();
+    }
+}
+
+uint32_t CoopTaskBase::nextDeadline()
+{
+    auto& sched = threadScheduler();
+    if (!sched.delayedTasksCount) return ~static_cast<uint32_t>(0);
+#if defined(ARDUINO)
+    const int32_t rem = static_cast<int32_t>(sched.delayedTasks[0]->deadline - micros());
+    return rem > 0 ? rem : 0;
+#else
+    const uint64_t now = CoopTaskBase::now();
+    const uint64_t deadline = sched.delayedTasks[0]->deadline;
+    if (deadline <= now) return 0;
+    const uint64_t rem = (deadline - now + 999UL) / 1000UL;
+    return rem > DELAY_MAXINT ? DELAY_MAXINT : static_cast<uint32_t>(rem);
+#endif
+}
+
 bool IRAM_ATTR CoopTaskBase::scheduleTask(bool wakeup)
 {
     if (!*this || !enrollRunnable()) return false;
@@ -267,6 +888,10 @@ bool IRAM_ATTR CoopTaskBase::scheduleTask(bool wakeup)
     {
         sleep(false);
     }
+    enqueueReady();
+#if defined(__linux__) && !defined(ARDUINO)
+    notifyIdle();
+#endif
 #if defined(ESP8266)
     return !reschedule || schedule_function([this]() { rescheduleTask(1); });
 #else
@@ -274,15 +899,45 @@ bool IRAM_ATTR CoopTaskBase::scheduleTask(bool wakeup)
 #endif
 }
 
+bool CoopTaskBase::restart(taskfunction_t _func) noexcept
+{
+    if (init && cont) return false;
+    delistRunnable();
+    dequeueReady();
+    dequeueDelayed();
+#if !defined(ARDUINO)
+    scheduler.store(nullptr);
+    pinned.store(false);
+#else
+    delay_duration = 0;
+#endif
+    taskPriority = 0;
+    inheritedPriority = 0;
+    mutexesHeld = 0;
+    taskWeight = 1;
+    virtualTime = 0;
+    lastPass = ~0U;
+    func = _func;
+    init = false;
+    cont = true;
+    sleeps.store(true);
+    delays.store(false);
+    delay_ms = false;
+    return true;
+}
+
 #if defined(_MSC_VER)
 
 CoopTaskBase::~CoopTaskBase()
 {
     if (taskFiber) DeleteFiber(taskFiber);
+    if (waitList) waitList->remove(this);
     delistRunnable();
+    dequeueReady();
+    dequeueDelayed();
 }
 
-LPVOID CoopTaskBase::primaryFiber = nullptr;
+thread_local LPVOID CoopTaskBase::primaryFiber = nullptr;
 
 void __stdcall CoopTaskBase::taskFiberFunc(void* self)
 {
@@ -312,40 +967,21 @@ int32_t CoopTaskBase::initialize()
 int32_t CoopTaskBase::run()
 {
     if (!cont) return -1;
-    if (sleeps.load()) return 0;
+    if (sleeps.load() && !delays.load()) return 0;
     if (delays.load())
     {
-        if (delay_ms)
-        {
-            auto expired = millis() - delay_start;
-            if (expired < delay_duration)
-            {
-                auto delay_rem = delay_duration - expired;
-                return static_cast<int32_t>(delay_rem) < 0 ? DELAY_MAXINT : delay_rem;
-            }
-        }
-        else
-        {
-            auto expired = micros() - delay_start;
-            if (expired < delay_duration)
-            {
-                auto delay_rem = delay_duration - expired;
-                if (delay_rem >= DELAYMICROS_THRESHOLD)
-                {
-                    return static_cast<int32_t>(delay_rem) < 0 ? DELAY_MAXINT : delay_rem;
-                }
-                ::delayMicroseconds(delay_rem);
-            }
-        }
+        const auto delay_rem = delayRemaining(now());
+        if (delay_rem) return delay_rem;
+        // the deadline also ends a timed sleep
+        sleeps.store(false);
         delays.store(false);
-        delay_duration = 0;
     }
     current = this;
     if (!init && initialize() < 0) return -1;
     SwitchToFiber(taskFiber);
     current = nullptr;
 
-    // val = 0: init; -1: exit() task; 1: yield task; 2: sleep task; 3: delay task for delay_duration
+    // val = 0: init; -1: exit() task; 1: yield task; 2: sleep task; 3: delay task until deadline
     cont = cont && (val > 0);
     sleeps.store(sleeps.load() || (val == 2));
     delays.store(delays.load() || (val > 2));
@@ -364,7 +1000,7 @@ int32_t CoopTaskBase::run()
         break;
     case 3:
     default:
-        return static_cast<int32_t>(delay_duration) < 0 ? DELAY_MAXINT : delay_duration;
+        return delayRemaining(now());
         break;
     }
 }
@@ -374,6 +1010,11 @@ size_t CoopTaskBase::getFreeStack() const
     return taskFiber ? taskStackSize : 0;
 }
 
+size_t CoopTaskBase::getPeakStack() const
+{
+    return init ? taskStackSize - getFreeStack() : 0;
+}
+
 void CoopTaskBase::doYield(unsigned val) noexcept
 {
     self()->val = val;
@@ -383,22 +1024,17 @@ void CoopTaskBase::doYield(unsigned val) noexcept
 void CoopTaskBase::_delay(uint32_t ms) noexcept
 {
     delay_ms = true;
-    delay_start = millis();
-    delay_duration = ms;
-    // CoopTask::run() defers task for delay_duration milliseconds.
+    deadline = now() + ms * 1000000ULL;
+    // CoopTask::run() defers task until deadline.
     doYield(3);
 }
 
 void CoopTaskBase::_delayMicroseconds(uint32_t us) noexcept
 {
-    if (us < DELAYMICROS_THRESHOLD) {
-        ::delayMicroseconds(us);
-        return;
-    }
+    if (!us) return;
     delay_ms = false;
-    delay_start = micros();
-    delay_duration = us;
-    // CoopTask::run() defers task for delay_duration microseconds.
+    deadline = now() + us * 1000ULL;
+    // CoopTask::run() defers task until deadline.
     doYield(3);
 }
 
@@ -424,17 +1060,28 @@ void IRAM_ATTR CoopTaskBase::sleep(const bool state) noexcept
     if (!state)
     {
         delays.store(false);
-        delay_duration = 0;
     }
 }
 
+void CoopTaskBase::sleepFor(uint32_t ms) noexcept
+{
+    delay_ms = true;
+    deadline = now() + ms * 1000000ULL;
+    // CoopTask::run() wakes up the sleeping task at the deadline.
+    sleeps.store(true);
+    delays.store(true);
+}
+
 #elif defined(ESP32_FREERTOS)
 
 CoopTaskBase::~CoopTaskBase()
 {
     if (taskHandle) vTaskDelete(taskHandle);
     taskHandle = nullptr;
+    if (waitList) waitList->remove(this);
     delistRunnable();
+    dequeueReady();
+    dequeueDelayed();
 }
 
 void CoopTaskBase::taskFunc(void* _self)
@@ -464,7 +1111,7 @@ int32_t CoopTaskBase::initialize()
 int32_t CoopTaskBase::run()
 {
     if (!cont) return -1;
-    if (sleeps.load()) return 0;
+    if (sleeps.load() && !delays.load()) return 0;
     if (delays.load())
     {
         if (delay_ms)
@@ -487,6 +1134,8 @@ int32_t CoopTaskBase::run()
                     auto delay_rem = delay_duration - expired;
                     return static_cast<int32_t>(delay_rem) < 0 ? DELAY_MAXINT : delay_rem;
                 }
+                // the deadline also ends a timed sleep
+                sleeps.store(false);
                 delays.store(false);
                 delay_duration = 0;
             }
@@ -590,6 +1239,11 @@ size_t CoopTaskBase::getFreeStack() const
     return taskHandle ? uxTaskGetStackHighWaterMark(taskHandle) : 0;
 }
 
+size_t CoopTaskBase::getPeakStack() const
+{
+    return init ? taskStackSize - getFreeStack() : 0;
+}
+
 void CoopTaskBase::_delay(uint32_t ms) noexcept
 {
     delays.store(true);
@@ -620,8 +1274,12 @@ void CoopTaskBase::_sleep() noexcept
 
 void CoopTaskBase::_yield() noexcept
 {
-    delay_duration = 0;
-    delays.store(false);
+    // the timed sleep of sleepFor() lasts across the yield
+    if (!sleeps.load())
+    {
+        delay_duration = 0;
+        delays.store(false);
+    }
     vTaskSuspend(taskHandle);
 }
 
@@ -641,6 +1299,16 @@ void IRAM_ATTR CoopTaskBase::sleep(const bool state) noexcept
     }
 }
 
+void CoopTaskBase::sleepFor(uint32_t ms) noexcept
+{
+    delay_ms = true;
+    delay_start = ESP.getCycleCount();
+    delay_duration = ms;
+    // CoopTask::run() wakes up the sleeping task after delay_duration milliseconds.
+    sleeps.store(true);
+    delays.store(true);
+}
+
 CoopTaskBase* CoopTaskBase::self() noexcept
 {
     const auto currentTaskHandle = xTaskGetCurrentTaskHandle();
@@ -656,22 +1324,181 @@ CoopTaskBase* CoopTaskBase::self() noexcept
 
 #else
 
+#if defined(COOPTASK_ASM_CONTEXT)
+
+extern "C"
+{
+    // Pushes the callee-saved registers onto the current stack and stores the stack pointer
+    // into *from, then restores the callee-saved registers from the stack at to and
+    // returns val on that stack.
+    intptr_t coopTaskSwitchContext(void** from, void* to, intptr_t val);
+    // First return address on a fresh task stack, calls the task entry in a callee-saved
+    // register with the task pointer from another one.
+    void coopTaskEntryTrampoline();
+}
+
+#if defined(__x86_64__)
+asm(
+    ".text\n"
+    ".globl coopTaskSwitchContext\n"
+    ".hidden coopTaskSwitchContext\n"
+    ".type coopTaskSwitchContext, @function\n"
+    ".p2align 4\n"
+    "coopTaskSwitchContext:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    movq %rdx, %rax\n"
+    "    ret\n"
+    ".size coopTaskSwitchContext, .-coopTaskSwitchContext\n"
+    ".globl coopTaskEntryTrampoline\n"
+    ".hidden coopTaskEntryTrampoline\n"
+    ".type coopTaskEntryTrampoline, @function\n"
+    ".p2align 4\n"
+    "coopTaskEntryTrampoline:\n"
+    "    movq %rbx, %rdi\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    ".size coopTaskEntryTrampoline, .-coopTaskEntryTrampoline\n"
+);
+#elif defined(__aarch64__)
+asm(
+    ".text\n"
+    ".globl coopTaskSwitchContext\n"
+    ".hidden coopTaskSwitchContext\n"
+    ".type coopTaskSwitchContext, %function\n"
+    ".p2align 4\n"
+    "coopTaskSwitchContext:\n"
+    "    sub sp, sp, #0xa0\n"
+    "    stp d8, d9, [sp, #0x00]\n"
+    "    stp d10, d11, [sp, #0x10]\n"
+    "    stp d12, d13, [sp, #0x20]\n"
+    "    stp d14, d15, [sp, #0x30]\n"
+    "    stp x19, x20, [sp, #0x40]\n"
+    "    stp x21, x22, [sp, #0x50]\n"
+    "    stp x23, x24, [sp, #0x60]\n"
+    "    stp x25, x26, [sp, #0x70]\n"
+    "    stp x27, x28, [sp, #0x80]\n"
+    "    stp x29, x30, [sp, #0x90]\n"
+    "    mov x9, sp\n"
+    "    str x9, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp d8, d9, [sp, #0x00]\n"
+    "    ldp d10, d11, [sp, #0x10]\n"
+    "    ldp d12, d13, [sp, #0x20]\n"
+    "    ldp d14, d15, [sp, #0x30]\n"
+    "    ldp x19, x20, [sp, #0x40]\n"
+    "    ldp x21, x22, [sp, #0x50]\n"
+    "    ldp x23, x24, [sp, #0x60]\n"
+    "    ldp x25, x26, [sp, #0x70]\n"
+    "    ldp x27, x28, [sp, #0x80]\n"
+    "    ldp x29, x30, [sp, #0x90]\n"
+    "    add sp, sp, #0xa0\n"
+    "    mov x0, x2\n"
+    "    ret\n"
+    ".size coopTaskSwitchContext, .-coopTaskSwitchContext\n"
+    ".globl coopTaskEntryTrampoline\n"
+    ".hidden coopTaskEntryTrampoline\n"
+    ".type coopTaskEntryTrampoline, %function\n"
+    ".p2align 4\n"
+    "coopTaskEntryTrampoline:\n"
+    "    mov x0, x19\n"
+    "    blr x20\n"
+    "    brk #0\n"
+    ".size coopTaskEntryTrampoline, .-coopTaskEntryTrampoline\n"
+);
+#endif
+
+thread_local void* CoopTaskBase::env = nullptr;
+
+void CoopTaskBase::taskEntry(CoopTaskBase* self) noexcept
+{
+    self->func();
+    self->_exit();
+}
+
+#elif defined(ARDUINO)
 jmp_buf CoopTaskBase::env;
+#else
+thread_local jmp_buf CoopTaskBase::env;
+#endif
 
 CoopTaskBase::~CoopTaskBase()
 {
+    if (waitList) waitList->remove(this);
     delistRunnable();
+    dequeueReady();
+    dequeueDelayed();
 }
 
 int32_t CoopTaskBase::initialize()
 {
     if (!cont || init) return -1;
     init = true;
-    // fill stack with magic values to check overflow, corruption, and high water mark
-    for (size_t pos = 0; pos <= (taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) / sizeof(STACKCOOKIE); ++pos)
+#if defined(__linux__) && !defined(ARDUINO)
+    if (stackDemandPaged)
     {
-        reinterpret_cast<unsigned*>(taskStackTop)[pos] = STACKCOOKIE;
+        // only the corruption check cookie, filling would commit every page of the stack
+        reinterpret_cast<unsigned*>(taskStackTop)[(taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) / sizeof(STACKCOOKIE)] = STACKCOOKIE;
     }
+    else
+#endif
+    {
+        // fill stack with magic values to check overflow, corruption, and high water mark.
+        // a restarted task refills from the band below its low water mark, without scanning the free stack.
+        // words that deeper frames dirtied between yields keep their values, getPeakStack() includes them.
+        size_t pos = 0;
+        if (stackLowWater)
+        {
+            pos = stackLowWater - reinterpret_cast<unsigned*>(taskStackTop);
+            pos = pos > STACKWATERMARKBAND ? pos - STACKWATERMARKBAND : 0;
+        }
+        for (; pos <= (taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) / sizeof(STACKCOOKIE); ++pos)
+        {
+            reinterpret_cast<unsigned*>(taskStackTop)[pos] = STACKCOOKIE;
+        }
+    }
+    stackLowWater = reinterpret_cast<unsigned*>(taskStackTop) + (taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) / sizeof(STACKCOOKIE);
+#if defined(COOPTASK_ASM_CONTEXT)
+    // lay out the initial frame for the first coopTaskSwitchContext() into the task
+    auto sp = reinterpret_cast<uint64_t*>(
+        ((reinterpret_cast<uintptr_t>(taskStackTop) + taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) >> 4) << 4);
+#if defined(__x86_64__)
+    sp -= 10;
+    sp[0] = 0x1f80 | (static_cast<uint64_t>(0x037f) << 32); // default MXCSR and x87 control word
+    sp[1] = sp[2] = sp[3] = 0; // r15, r14, r13
+    sp[4] = reinterpret_cast<uintptr_t>(&taskEntry); // r12
+    sp[5] = reinterpret_cast<uintptr_t>(this); // rbx
+    sp[6] = 0; // rbp
+    sp[7] = reinterpret_cast<uintptr_t>(&coopTaskEntryTrampoline); // return address
+    sp[8] = 0; // the trampoline never returns
+#else
+    sp -= 20;
+    for (size_t i = 0; i < 20; ++i) sp[i] = 0; // d8-d15, x19-x30
+    sp[8] = reinterpret_cast<uintptr_t>(this); // x19
+    sp[9] = reinterpret_cast<uintptr_t>(&taskEntry); // x20
+    sp[19] = reinterpret_cast<uintptr_t>(&coopTaskEntryTrampoline); // x30
+#endif
+    env_yield = sp;
+    return 0;
+#else
 #if defined(__GNUC__) && (defined(__amd64__) || defined(__amd64) || defined(__x86_64__) || defined(__x86_64))
     asm volatile (
         "movq %0, %%rsp"
@@ -691,14 +1518,19 @@ int32_t CoopTaskBase::initialize()
     cont = false;
     delistRunnable();
     return -1;
+#endif
 }
 
 int32_t CoopTaskBase::run()
 {
     if (!cont) return -1;
-    if (sleeps.load()) return 0;
+    if (sleeps.load() && !delays.load()) return 0;
     if (delays.load())
     {
+#if !defined(ARDUINO)
+        const auto delay_rem = delayRemaining(now());
+        if (delay_rem) return delay_rem;
+#else
         if (delay_ms)
         {
 #if defined(ESP8266) || defined(ESP32)
@@ -741,9 +1573,28 @@ int32_t CoopTaskBase::run()
                 ::delayMicroseconds(delay_rem);
             }
         }
-        delays.store(false);
         delay_duration = 0;
+#endif
+        // the deadline also ends a timed sleep
+        sleeps.store(false);
+        delays.store(false);
+    }
+#if defined(COOPTASK_ASM_CONTEXT)
+    current = this;
+    if (!init && initialize() < 0)
+    {
+        current = nullptr;
+        return -1;
     }
+    if (FULLFEATURES && *reinterpret_cast<unsigned*>(taskStackTop + taskStackSize + sizeof(STACKCOOKIE)) != STACKCOOKIE)
+    {
+        ::printf(PSTR("FATAL ERROR: CoopTask %s stack corrupted\n"), name().c_str());
+        ::abort();
+    }
+    // val = -1: exit() task; 1: yield task; 2: sleep task; 3: delay task until deadline
+    const auto val = static_cast<int>(coopTaskSwitchContext(&env, env_yield, 1));
+    {
+#else
     auto val = setjmp(env);
     // val = 0: init; -1: exit() task; 1: yield task; 2: sleep task; 3: delay task for delay_duration
     if (!val) {
@@ -761,8 +1612,14 @@ int32_t CoopTaskBase::run()
     }
     else
     {
+#endif
         current = nullptr;
+#if defined(__linux__) && !defined(ARDUINO)
+        // a demand paged stack overflows into its guard page
+        if (!stackDemandPaged && *reinterpret_cast<unsigned*>(taskStackTop) != STACKCOOKIE)
+#else
         if (*reinterpret_cast<unsigned*>(taskStackTop) != STACKCOOKIE)
+#endif
         {
 #ifndef ARDUINO_attiny
             ::printf(PSTR("FATAL ERROR: CoopTask %s stack overflow\n"), name().c_str());
@@ -770,8 +1627,8 @@ int32_t CoopTaskBase::run()
             ::abort();
         }
         cont = cont && (val > 0);
-        sleeps.store(sleeps.load() || (val == 2));
-        delays.store(delays.load() || (val > 2));
+        if (val == 2) sleeps.store(true);
+        else if (val > 2) delays.store(true);
     }
     if (!cont) {
         delistRunnable();
@@ -785,7 +1642,11 @@ int32_t CoopTaskBase::run()
         break;
     case 3:
     default:
+#if defined(ARDUINO)
         return static_cast<int32_t>(delay_duration) < 0 ? DELAY_MAXINT : delay_duration;
+#else
+        return delayRemaining(now());
+#endif
         break;
     }
 }
@@ -793,12 +1654,7 @@ int32_t CoopTaskBase::run()
 void CoopTaskBase::dumpStack() const
 {
     if (!taskStackTop) return;
-    size_t pos;
-    for (pos = 1; pos < (taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) / sizeof(STACKCOOKIE); ++pos)
-    {
-        if (STACKCOOKIE != reinterpret_cast<unsigned*>(taskStackTop)[pos])
-            break;
-    }
+    size_t pos = getFreeStack() / sizeof(unsigned) + 1;
 #ifndef ARDUINO_attiny
     ::printf(PSTR(">>>stack>>>\n"));
 #endif
@@ -823,21 +1679,66 @@ void CoopTaskBase::dumpStack() const
 size_t CoopTaskBase::getFreeStack() const
 {
     if (!taskStackTop) return 0;
-    size_t pos;
-    for (pos = 1; pos < (taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) / sizeof(STACKCOOKIE); ++pos)
+#if defined(__linux__) && !defined(ARDUINO)
+    if (stackDemandPaged)
     {
-        if (STACKCOOKIE != reinterpret_cast<unsigned*>(taskStackTop)[pos])
-            break;
+        // the stack grows down, the pages below the lowest resident page were never touched.
+        // pages that got swapped out count as free.
+        const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        const uintptr_t bottom = reinterpret_cast<uintptr_t>(taskStackTop);
+        const uintptr_t top = bottom + taskStackSize + (FULLFEATURES ? 2 : 1) * sizeof(STACKCOOKIE);
+        uintptr_t page = bottom & ~(pageSize - 1);
+        while (page < top)
+        {
+            unsigned char residency[64];
+            const size_t count = std::min<size_t>(sizeof(residency), (top - page + pageSize - 1) / pageSize);
+            if (mincore(reinterpret_cast<void*>(page), count * pageSize, residency)) return 0;
+            for (size_t i = 0; i < count; ++i, page += pageSize)
+            {
+                if (residency[i] & 1) return page > bottom ? std::min<size_t>(page - bottom, taskStackSize) : 0;
+            }
+        }
+        return taskStackSize;
     }
-    return (pos - 1) * sizeof(unsigned);
+#endif
+    return scanFreeStack(STACKWATERMARKBAND);
+}
+
+size_t CoopTaskBase::getPeakStack() const
+{
+    if (!init || !taskStackTop) return 0;
+#if defined(__linux__) && !defined(ARDUINO)
+    if (stackDemandPaged) return taskStackSize - getFreeStack();
+#endif
+    return taskStackSize - scanFreeStack(~static_cast<size_t>(0));
+}
+
+size_t CoopTaskBase::scanFreeStack(size_t band) const
+{
+    auto stack = reinterpret_cast<unsigned*>(taskStackTop);
+    const size_t words = (taskStackSize + (FULLFEATURES ? sizeof(STACKCOOKIE) : 0)) / sizeof(STACKCOOKIE);
+    // the words above the low water mark are known to be in use. below it, untouched locals
+    // may hide deeper frames that ran between yields, scan the band bottom-up to the first touched word.
+    const size_t mark = (stackLowWater > stack && stackLowWater < stack + words) ? stackLowWater - stack : words;
+    size_t used = mark > band ? mark - band : 1;
+    while (used < mark && STACKCOOKIE == stack[used]) ++used;
+    stackLowWater = stack + used;
+    return (used - 1) * sizeof(unsigned);
 }
 
 void CoopTaskBase::doYield(unsigned val) noexcept
 {
+    // sample the stack depth, this frame is near the deepest one of the yielding call chain
+    unsigned sp;
+    if (&sp < stackLowWater) stackLowWater = &sp;
+#if defined(COOPTASK_ASM_CONTEXT)
+    coopTaskSwitchContext(&env_yield, env, val);
+#else
     if (!setjmp(env_yield))
     {
         longjmp(env, val);
     }
+#endif
 }
 
 void CoopTaskBase::_delay(uint32_t ms) noexcept
@@ -847,30 +1748,52 @@ void CoopTaskBase::_delay(uint32_t ms) noexcept
     delay_start = usingBuiltinScheduler ? millis() : ESP.getCycleCount();
 #elif ESP32
     delay_start = ESP.getCycleCount();
-#else
+#elif defined(ARDUINO)
     delay_start = millis();
+#else
+    deadline = now() + ms * 1000000ULL;
 #endif
+#if defined(ARDUINO)
     delay_duration = ms;
     // CoopTask::run() defers task for delay_duration milliseconds.
+#else
+    // CoopTask::run() defers task until deadline.
+#endif
     doYield(3);
 }
 
 void CoopTaskBase::_delayMicroseconds(uint32_t us) noexcept
 {
+#if defined(ARDUINO)
     if (us < DELAYMICROS_THRESHOLD) {
         ::delayMicroseconds(us);
         return;
     }
+#else
+    if (!us) return;
+#endif
     delay_ms = false;
+#if defined(ARDUINO)
     delay_start = micros();
     delay_duration = us;
     // CoopTask::run() defers task for delay_duration microseconds.
+#else
+    deadline = now() + us * 1000ULL;
+    // CoopTask::run() defers task until deadline.
+#endif
     doYield(3);
 }
 
 void CoopTaskBase::_exit() noexcept
 {
+    // like doYield(), such that a restart refills the stack the task used
+    unsigned sp;
+    if (&sp < stackLowWater) stackLowWater = &sp;
+#if defined(COOPTASK_ASM_CONTEXT)
+    coopTaskSwitchContext(&env_yield, env, -1);
+#else
     longjmp(env, -1);
+#endif
 }
 
 void CoopTaskBase::_yield() noexcept
@@ -889,17 +1812,43 @@ void IRAM_ATTR CoopTaskBase::sleep(const bool state) noexcept
     if (!state)
     {
         delays.store(false);
+#if defined(ARDUINO)
         delay_duration = 0;
+#endif
     }
 }
 
+void CoopTaskBase::sleepFor(uint32_t ms) noexcept
+{
+    delay_ms = true;
+#ifdef ESP8266
+    delay_start = usingBuiltinScheduler ? millis() : ESP.getCycleCount();
+#elif ESP32
+    delay_start = ESP.getCycleCount();
+#elif defined(ARDUINO)
+    delay_start = millis();
+#else
+    deadline = now() + ms * 1000000ULL;
+#endif
+#if defined(ARDUINO)
+    delay_duration = ms;
+    // CoopTask::run() wakes up the sleeping task after delay_duration milliseconds.
+#else
+    // CoopTask::run() wakes up the sleeping task at the deadline.
+#endif
+    sleeps.store(true);
+    delays.store(true);
+}
+
 #endif // _MSC_VER
 
-void runCoopTasks(const Delegate<void(const CoopTaskBase* const task)>& reaper,
-    const Delegate<bool(uint32_t ms)>& onDelay, const Delegate<bool()>& onSleep)
+#ifdef ESP32_FREERTOS
+TaskHandle_t CoopTaskBase::yieldGuardHandle = nullptr;
+#endif
+
+void CoopTaskBase::beginRun(RunState& state)
 {
 #ifdef ESP32_FREERTOS
-    static TaskHandle_t yieldGuardHandle = nullptr;
     if (!yieldGuardHandle)
     {
         xTaskCreateUniversal([](void*)
@@ -911,55 +1860,63 @@ void runCoopTasks(const Delegate<void(const CoopTaskBase* const task)>& reaper,
             }, "YieldGuard", 0x200, nullptr, 1, &yieldGuardHandle, CONFIG_ARDUINO_RUNNING_CORE);
     }
 #endif
-
-    auto taskCount = CoopTaskBase::getRunnableTasksCount();
-    bool allSleeping = true;
-    uint32_t minDelay_ms = ~(decltype(minDelay_ms))0U;
-    for (size_t i = 0; taskCount && i < CoopTaskBase::getRunnableTasks().size(); ++i)
+#if defined(__linux__) && !defined(ARDUINO)
+    // only a thread that may block at the end of the pass makes scheduleTask() bump the futex word
+    if (blockingIdleMode())
     {
-#if defined(ESP8266) || defined(ESP32)
-        optimistic_yield(10000);
+        state.idleEpoch = beginIdle();
+        state.idleCounted = true;
+    }
+#else
+    (void)state;
 #endif
-        auto task = CoopTaskBase::getRunnableTasks()[i].load();
-        if (task)
+}
+
+void CoopTaskBase::endPass(RunState& state)
+{
+#if defined(__linux__) && !defined(ARDUINO)
+    // a custom clock, like CoopManualClock, need not advance in real time.
+    // tasks that exited leave the caller a chance to act, before blocking without any tasks
+    state.idle = state.idleCounted && (state.allSleeping ? !state.reaped :
+        state.minDelay_us > IDLE_SPIN_US && usingSteadyClock());
+    if (state.idle && !state.allSleeping)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &state.idleUntil);
+        const uint32_t sleep_us = state.minDelay_us - IDLE_SPIN_US;
+        state.idleUntil.tv_sec += sleep_us / 1000000UL;
+        state.idleUntil.tv_nsec += (sleep_us % 1000000UL) * 1000L;
+        if (state.idleUntil.tv_nsec >= 1000000000L)
         {
-            --taskCount;
-            auto runResult = task->run();
-            if (runResult < 0 && reaper)
-                reaper(task);
-            else if (minDelay_ms)
-            {
-                if (task->delayed())
-                {
-                    allSleeping = false;
-                    uint32_t delay_ms = task->delayIsMs() ? static_cast<uint32_t>(runResult) : static_cast<uint32_t>(runResult) / 1000UL;
-                    if (delay_ms < minDelay_ms)
-                        minDelay_ms = delay_ms;
-                }
-                else if (!task->sleeping())
-                {
-                    allSleeping = false;
-                    minDelay_ms = 0;
-                }
-            }
+            ++state.idleUntil.tv_sec;
+            state.idleUntil.tv_nsec -= 1000000000L;
         }
     }
+#else
+    (void)state;
+#endif
+}
 
-    bool cleanup = true;
-    if (allSleeping && onSleep)
-    {
-        cleanup = onSleep();
-    }
-    else if (minDelay_ms && onDelay)
-    {
-        cleanup = onDelay(minDelay_ms);
-    }
-    if (cleanup)
-    {
+void CoopTaskBase::idleRun(const RunState& state)
+{
 #ifdef ESP32_FREERTOS
-        vTaskSuspend(yieldGuardHandle);
-        vTaskDelay(1);
-        vTaskResume(yieldGuardHandle);
+    vTaskSuspend(yieldGuardHandle);
+    vTaskDelay(1);
+    vTaskResume(yieldGuardHandle);
 #endif
+#if defined(__linux__) && !defined(ARDUINO)
+    // block for all but the last IDLE_SPIN_US microseconds, further scheduling passes reach the deadline precisely,
+    // scheduling any task ends the wait early
+    if (state.idle)
+    {
+        waitIdle(state.idleEpoch, state.allSleeping ? nullptr : &state.idleUntil);
     }
+#else
+    (void)state;
+#endif
+}
+
+void runCoopTasks(const Delegate<void(const CoopTaskBase* const task)>& reaper,
+    const Delegate<bool(uint32_t ms)>& onDelay, const Delegate<bool()>& onSleep)
+{
+    CoopTaskBase::runTasks(reaper, onDelay, onSleep);
 }
@@ -35,12 +35,17 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <Arduino.h>
 #elif defined(_MSC_VER)
 #include <array>
+#include <vector>
 #include <Windows.h>
 #include <string>
 #else
 #include <array>
+#include <vector>
 #include <csetjmp>
 #include <string>
+#if defined(__linux__)
+#include <time.h>
+#endif
 #endif
 
 #if defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
@@ -49,6 +54,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "circular_queue/ghostl.h"
 #endif
 
+#if !defined(ARDUINO)
+#include "CoopTaskRegistry.h"
+#endif
+#include "CoopSchedulingPolicy.h"
+
 #if !defined(ESP32) && !defined(ESP8266)
 #define IRAM_ATTR
 #endif
@@ -57,6 +67,17 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define __attribute__(_)
 #endif
 
+// On x86-64 and AArch64 Linux, define COOPTASK_USE_ASM_CONTEXT to switch task context by saving only
+// the callee-saved registers, instead of setjmp()/longjmp(). Measured through runCoopTasks(), the yield
+// round-trip is the same within noise, setjmp() remains the default.
+#if !defined(ARDUINO) && defined(__GNUC__) && defined(__ELF__) && \
+    (defined(__x86_64__) || defined(__aarch64__)) && defined(COOPTASK_USE_ASM_CONTEXT)
+#define COOPTASK_ASM_CONTEXT
+#endif
+
+class CoopWaitList;
+class CoopMutex;
+
 class CoopTaskBase
 {
 public:
@@ -70,7 +91,15 @@ protected:
 #else
     CoopTaskBase(const std::string& name, taskfunction_t _func, size_t stackSize = DEFAULTTASKSTACKSIZE) :
 #endif
-        taskName(name), sleeps(true), delays(false), func(_func)
+        taskName(name),
+#if !defined(ARDUINO)
+        runnableIndex(NOTENROLLED),
+#endif
+        sleeps(true), delays(false),
+#if !defined(ARDUINO)
+        scheduler(nullptr), pinned(false),
+#endif
+        readyQueued(false), func(_func)
     {
         taskStackSize = (sizeof(unsigned) >= 4) ? ((stackSize + sizeof(unsigned) - 1) / sizeof(unsigned)) * sizeof(unsigned) : stackSize;
     }
@@ -88,7 +117,7 @@ protected:
 
     size_t taskStackSize;
 #if defined(_MSC_VER)
-    static LPVOID primaryFiber;
+    static thread_local LPVOID primaryFiber;
     LPVOID taskFiber = nullptr;
     int val = 0;
     static void __stdcall taskFiberFunc(void* self);
@@ -97,20 +126,177 @@ protected:
     static void taskFunc(void* _self);
 #else
     char* taskStackTop = nullptr;
+    // the lowest stack word known to be in use, sampled at each yield and lowered by getFreeStack(),
+    // which scans a band of STACKWATERMARKBAND words below it, and by getPeakStack(), which scans all of them.
+    mutable unsigned* stackLowWater = nullptr;
+    static constexpr size_t STACKWATERMARKBAND = FULLFEATURES ? 16 : 4;
+    /// Lowers stackLowWater to the lowest touched word within band words below it.
+    /// @returns: the free stack space below the lowered mark.
+    size_t scanFreeStack(size_t band) const;
+#if defined(__linux__) && !defined(ARDUINO)
+    // the stack is committed on touch, behind a guard page. initialize() sets only the top cookie,
+    // getFreeStack() checks page residency.
+    bool stackDemandPaged = false;
+#endif
+#if defined(COOPTASK_ASM_CONTEXT)
+    // saved stack pointers, the callee-saved registers are on the stack they point into
+    static thread_local void* env;
+    void* env_yield = nullptr;
+    static void taskEntry(CoopTaskBase* self) noexcept;
+#elif defined(ARDUINO)
     static jmp_buf env;
     jmp_buf env_yield;
+#else
+    static thread_local jmp_buf env;
+    jmp_buf env_yield;
+#endif
 #endif
+#if defined(ARDUINO)
     static constexpr size_t MAXNUMBERCOOPTASKS = FULLFEATURES ? 32 : 8;
     // for lock-free insertion, must be one element larger than max task count
-    static std::array< std::atomic<CoopTaskBase* >, MAXNUMBERCOOPTASKS + 1> runnableTasks;
+    template<typename T> using RunnableTasks = std::array< std::atomic<T* >, MAXNUMBERCOOPTASKS + 1>;
+#else
+    // grows on demand, enrollment stays lock-free
+    template<typename T> using RunnableTasks = CoopTaskRegistry<T>;
+    static constexpr size_t MAXNUMBERCOOPTASKS = RunnableTasks<CoopTaskBase>::max_size();
+    static constexpr size_t NOTENROLLED = ~static_cast<size_t>(0);
+    // lowest index in runnableTasks that may be free
+    static std::atomic<size_t> runnableTasksFree;
+    std::atomic<size_t> runnableIndex;
+#endif
+    static RunnableTasks<CoopTaskBase> runnableTasks;
     static std::atomic<size_t> runnableTasksCount;
+#if defined(ARDUINO)
     static CoopTaskBase* current;
+#else
+    static thread_local CoopTaskBase* current;
+#endif
     bool init = false;
     bool cont = true;
     std::atomic<bool> sleeps;
     // ESP32 FreeRTOS (#define ESP32_FREERTOS) handles delays, on this platfrom delays is always false
     std::atomic<bool> delays;
 
+    static bool usingReadyQueue;
+#if defined(__linux__) && !defined(ARDUINO)
+    static bool usingBlockingIdle;
+    // bumped by scheduleTask() while idleWaiters is not 0, idle threads wait on it as a futex
+    static std::atomic<uint32_t> idleWakeups;
+    // the threads between beginIdle() and endIdle(), and of these, the threads blocked in waitIdle()
+    static std::atomic<uint32_t> idleWaiters;
+    static std::atomic<uint32_t> idleSleepers;
+    static void notifyIdle();
+#endif
+    // The ready queue mode scheduling state of a thread that runs CoopTasks.
+    struct Scheduler
+    {
+        Scheduler() : readyTasks(nullptr) {}
+        // lock-free LIFO of tasks readied since the last scheduling pass, linked through readyNext
+        std::atomic<CoopTaskBase*> readyTasks;
+        // the ready tasks in the order of the scheduling policy, in FIFO order among equals,
+        // only accessed by the owning thread
+        CoopTaskBase* readyPass = nullptr;
+        CoopTaskBase* readyPassTail = nullptr;
+        CoopFixedPriorityPolicy defaultPolicy;
+        CoopSchedulingPolicy* policy = &defaultPolicy;
+        // counts the scheduling passes, each task runs at most once per pass
+        unsigned pass = 0;
+        // binary min-heap of delayed tasks, keyed on their deadline, only accessed by the owning thread
+#if defined(ARDUINO)
+        std::array<CoopTaskBase*, MAXNUMBERCOOPTASKS> delayedTasks;
+#else
+        std::vector<CoopTaskBase*> delayedTasks;
+#endif
+        size_t delayedTasksCount = 0;
+#if !defined(ARDUINO)
+        // held by other threads while they move tasks out of readyTasks, and while a task is
+        // unlinked for deletion, such that a task is neither deleted nor stolen while it is moved
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        void acquire() noexcept { while (lock.test_and_set(std::memory_order_acquire)) {} }
+        void release() noexcept { lock.clear(std::memory_order_release); }
+        bool unlinkReady(CoopTaskBase* task);
+#endif
+
+        void push(CoopTaskBase* first, CoopTaskBase* last);
+        bool takeReady();
+        void insertPass(CoopTaskBase* task);
+        bool unlinkPass(CoopTaskBase* task);
+        void siftUpDelayed(size_t pos);
+        void siftDownDelayed(size_t pos);
+    };
+#if defined(ARDUINO)
+    static Scheduler localScheduler;
+    Scheduler& homeScheduler() noexcept { return localScheduler; }
+#else
+    static thread_local Scheduler* localScheduler;
+    static constexpr size_t MAXNUMBERSCHEDULERS = 64;
+    // every thread that has run CoopTasks in ready queue mode, for work stealing
+    static std::array<std::atomic<Scheduler*>, MAXNUMBERSCHEDULERS> schedulers;
+    static bool usingWorkStealing;
+    // holds the tasks that were readied on threads that do not run CoopTasks, until a scheduler adopts them
+    static Scheduler& unhomedScheduler();
+    static void adoptUnhomedTasks(Scheduler& sched);
+    // the scheduler that runs the task, set when the task is first readied
+    std::atomic<Scheduler*> scheduler;
+    // set once the task was taken to run, it is no longer eligible for work stealing
+    std::atomic<bool> pinned;
+    Scheduler& homeScheduler() noexcept;
+#endif
+    static Scheduler& threadScheduler();
+    CoopTaskBase* readyNext = nullptr;
+    // true while the task is either in readyTasks or in readyPass
+    std::atomic<bool> readyQueued;
+    static constexpr size_t NOTDELAYED = ~static_cast<size_t>(0);
+    size_t delayedIndex = NOTDELAYED;
+    friend class CoopWaitList;
+    // the wait list that the task is linked into while it waits, for instance on a CoopSemaphore
+    CoopWaitList* waitList = nullptr;
+    CoopTaskBase* waitPrev = nullptr;
+    CoopTaskBase* waitNext = nullptr;
+    friend class CoopMutex;
+    // the priority set by setPriority(), and the highest priority of the tasks waiting on a CoopMutex held by this task
+    uint8_t taskPriority = 0;
+    uint8_t inheritedPriority = 0;
+    // the number of CoopMutex locks held, the inherited priority is dropped when the last one is unlocked
+    unsigned mutexesHeld = 0;
+    void inheritPriority(uint8_t prio) noexcept;
+    // in ready queue mode, moves the queued task to the position of its changed priority
+    void requeueReady() noexcept;
+    friend class CoopWeightedFairPolicy;
+    uint8_t taskWeight = 1;
+    // the weighted run time of the task, for CoopWeightedFairPolicy
+    uint64_t virtualTime = 0;
+    // the scheduling pass that the task last ran in
+    unsigned lastPass = ~0U;
+#if defined(ARDUINO)
+    // absolute expiry in micros(), wrap-around safe for deadlines less than DELAY_MAXINT ahead
+    uint32_t deadline = 0;
+
+    static bool deadlineBefore(const CoopTaskBase* a, const CoopTaskBase* b) noexcept
+    {
+        return static_cast<int32_t>(a->deadline - b->deadline) < 0;
+    }
+#else
+    // absolute expiry of the delay in nanoseconds of now(), also keys the delayed tasks heap
+    uint64_t deadline = 0;
+
+    static bool deadlineBefore(const CoopTaskBase* a, const CoopTaskBase* b) noexcept
+    {
+        return a->deadline < b->deadline;
+    }
+    /// @returns: the time until deadline, rounded up to the unit of delayIsMs(), 0 if it has expired.
+    int32_t delayRemaining(uint64_t now) const noexcept
+    {
+        if (now >= deadline) return 0;
+        const uint64_t rem = delay_ms ? (deadline - now + 999999UL) / 1000000UL : (deadline - now + 999UL) / 1000UL;
+        return rem > DELAY_MAXINT ? DELAY_MAXINT : static_cast<int32_t>(rem);
+    }
+
+    using ClockSource = uint64_t(*)();
+    static ClockSource clockSource;
+#endif
+    void dequeueDelayed();
+
     int32_t initialize();
     void doYield(unsigned val) noexcept;
 
@@ -120,6 +306,47 @@ protected:
 #endif
     bool IRAM_ATTR enrollRunnable();
     void delistRunnable();
+    void dequeueReady();
+    /// Like enqueueReady(), but sorts the task into the scheduling pass at once, instead of
+    /// pushing it onto the ready list that the next pass takes over. Use only from the thread
+    /// of the task's scheduler, and not from interrupt service routines or signal handlers.
+    void enqueuePass();
+
+    /// Prepares a task that has exited, or never run, to run the given task function from the start,
+    /// reusing its stack. It is sleeping until the next scheduleTask(). Priority, weight, and the scheduling
+    /// state of the policies are reset to those of a new task.
+    /// @returns: false if the task has started and not yet exited.
+    bool restart(taskfunction_t _func) noexcept;
+
+    // the bookkeeping of one runCoopTasks() call
+    struct RunState
+    {
+        bool allSleeping = true;
+        bool reaped = false;
+        uint32_t minDelay_ms = ~static_cast<uint32_t>(0);
+        // the same minimum delay with microsecond resolution, capped like nextDeadline()
+        uint32_t minDelay_us = ~static_cast<uint32_t>(0);
+#if defined(__linux__) && !defined(ARDUINO)
+        // tasks that get scheduled after this, even during the pass, end the idle wait at once
+        uint32_t idleEpoch = 0;
+        // in blocking idle mode, the thread is counted by beginIdle() for the whole runCoopTasks() call
+        bool idleCounted = false;
+        bool idle = false;
+        // the idle deadline is absolute, such that time spent in the hooks counts against it
+        timespec idleUntil;
+        ~RunState()
+        {
+            if (idleCounted) endIdle();
+        }
+#endif
+    };
+#ifdef ESP32_FREERTOS
+    static TaskHandle_t yieldGuardHandle;
+#endif
+    static void beginRun(RunState& state);
+    // decides on the default housekeeping of the idle runCoopTasks() call
+    static void endPass(RunState& state);
+    static void idleRun(const RunState& state);
 
     void _exit() noexcept;
     void _yield() noexcept;
@@ -128,10 +355,15 @@ protected:
     void _delayMicroseconds(uint32_t us) noexcept;
 
 private:
+#if defined(ARDUINO)
     // true: delay_start/delay_duration are in milliseconds; false: delay_start/delay_duration are in microseconds.
     bool delay_ms = false;
     uint32_t delay_start = 0;
     uint32_t delay_duration = 0;
+#else
+    // true: run() returns the remaining delay in milliseconds; false: in microseconds.
+    bool delay_ms = false;
+#endif
 
     taskfunction_t func;
 
@@ -170,6 +402,34 @@ public:
     bool IRAM_ATTR scheduleTask(bool wakeup = true);
     inline bool IRAM_ATTR wakeup() __attribute__((always_inline)) { return scheduleTask(true); }
 
+    /// Wakes up tasks like scheduleTask(true), for instance the tasks that a synchronization object
+    /// releases together. In ready queue mode, the tasks are linked into the ready list of their scheduler
+    /// at once, and idle threads are notified once, when the batch is flushed or destroyed.
+    /// A batch is used by a single thread, and must be flushed before any of its tasks is deleted.
+    class WakeBatch
+    {
+    public:
+        WakeBatch() = default;
+        WakeBatch(const WakeBatch&) = delete;
+        WakeBatch& operator=(const WakeBatch&) = delete;
+        ~WakeBatch()
+        {
+            flush();
+        }
+        /// @returns: true on success, like scheduleTask(true).
+        bool IRAM_ATTR add(CoopTaskBase* task);
+        void IRAM_ATTR flush();
+
+    protected:
+#if !defined(ARDUINO)
+        Scheduler* sched = nullptr;
+        // the task added last heads the chain, like pushing the tasks one by one
+        CoopTaskBase* first = nullptr;
+        CoopTaskBase* last = nullptr;
+        bool notify = false;
+#endif
+    };
+
 #ifdef ESP8266
     /// For full access to all features, cyclic task scheduling, state evaluation
     /// and running are performed explicitly from user code. For convenience, the function
@@ -189,9 +449,127 @@ public:
         usingBuiltinScheduler = state;
     }
 #endif
+    /// By default, runCoopTasks() calls run() on every task in getRunnableTasks() in each pass,
+    /// regardless if it is sleeping. In ready queue mode, scheduleTask() and wakeup() push the task onto
+    /// an intrusive ready list instead, and a scheduling pass only runs the tasks from that list, such that
+    /// its cost does not grow with the number of sleeping tasks.
+    /// The ready list is not free, with all tasks runnable, a pass costs about as much as in the
+    /// default mode, and small passes of a few tasks take longer. Ready queue mode pays off if
+    /// most tasks sleep or are delayed most of the time.
+    /// The scheduler selection should be done before the first CoopTask is created, and not
+    /// changed thereafter during runtime.
+    /// On Linux and Windows, each OS thread that calls runCoopTasks() in ready queue mode has its own
+    /// scheduler. A task belongs to the scheduler of the thread that first schedules it, if that thread
+    /// runs CoopTasks, otherwise to the first thread that runs a scheduling pass after that.
+    /// scheduleTask() and CoopSemaphore::post() from any other thread ready it on that scheduler.
+    /// A task must be deleted on the thread of its scheduler, or while no thread runs CoopTasks,
+    /// once another thread has taken it into a scheduling pass, deleting it is not safe.
+    /// The order in which a pass runs the ready tasks is up to the scheduling policy, by default
+    /// strict fixed priority, see useSchedulingPolicy().
+    /// @param state true: The parameter default value. Scheduling uses the ready list.
+    static void useReadyQueue(bool state = true)
+    {
+        usingReadyQueue = state;
+    }
+    static bool readyQueueMode()
+    {
+        return usingReadyQueue;
+    }
+#if !defined(ARDUINO)
+    /// In ready queue mode, a scheduler that has no ready tasks of its own may take over
+    /// ready tasks from the schedulers on other threads, as long as these have never run yet.
+    /// Once a task has run, or has been taken over, it is pinned to its scheduler.
+    /// As a task that has not run yet may move to another thread at any time, delete
+    /// such tasks only after they exited, for instance from the reaper of runCoopTasks().
+    /// @param state true: The parameter default value. Idle schedulers steal work.
+    static void useWorkStealing(bool state = true)
+    {
+        usingWorkStealing = state;
+    }
+    /// In ready queue mode with work stealing, moves a share of the not yet pinned ready tasks
+    /// from another thread's scheduler to the calling thread's.
+    /// @returns: true if any task was taken over.
+    static bool stealReadyTasks();
+#endif
+#if defined(__linux__) && !defined(ARDUINO)
+    /// By default, runCoopTasks() returns at once if all tasks are sleeping or delayed, and the caller
+    /// loops over it. In blocking idle mode, it blocks the calling thread instead, until any task is
+    /// scheduled or woken up, for instance by CoopSemaphore::post() from another thread or a signal handler,
+    /// and, if tasks are delayed, at most until shortly before the earliest deadline.
+    /// @param state true: The parameter default value. Idle runCoopTasks() blocks.
+    static void useBlockingIdle(bool state = true)
+    {
+        usingBlockingIdle = state;
+    }
+    static bool blockingIdleMode()
+    {
+        return usingBlockingIdle;
+    }
+    /// Counts the calling thread as one that may block in waitIdle(), before it checks its tasks for being idle.
+    /// While no thread is counted, scheduleTask() skips the idle wakeup entirely. Each call must be
+    /// paired with endIdle().
+    /// @returns: a token that changes whenever scheduleTask() is called from then on, for waitIdle().
+    static uint32_t beginIdle();
+    static void endIdle()
+    {
+        idleWaiters.fetch_sub(1);
+    }
+    /// Blocks the calling thread until scheduleTask() has been called after epoch was taken,
+    /// or the deadline has passed.
+    /// @param epoch the return of beginIdle() before the tasks were last checked for being idle.
+    /// @param until the absolute deadline on CLOCK_MONOTONIC, nullptr to wait without deadline.
+    static void waitIdle(uint32_t epoch, const struct timespec* until);
+#endif
+    /// In ready queue mode, starts a scheduling pass by taking over all tasks that were readied
+    /// since the previous pass.
+    /// @returns: true if the pass is not empty.
+    static bool beginReadyPass();
+    /// In ready queue mode, removes the next task from the current scheduling pass, after taking
+    /// in the tasks that were readied, or whose deadline expired, since the last call.
+    /// @returns: the task, or nullptr if the pass is complete, either because the next task has
+    /// already run in this pass, or the scheduling policy does not admit it. The remaining tasks
+    /// stay ready for a later pass.
+    static CoopTaskBase* nextReadyTask();
+    /// In ready queue mode, reports to the scheduling policy that the task returned by
+    /// nextReadyTask() has run. Call it before the task may get deleted.
+    static void readyTaskRan(CoopTaskBase* task)
+    {
+        threadScheduler().policy->ran(task);
+    }
+    /// Selects the scheduling policy of the calling thread's scheduler in ready queue mode,
+    /// for instance a CoopWeightedFairPolicy. The ready tasks are reordered by the new policy.
+    /// Each scheduler needs its own policy instance, which must remain valid as long as it is selected.
+    /// @param policy the scheduling policy, nullptr selects the default CoopFixedPriorityPolicy.
+    static void useSchedulingPolicy(CoopSchedulingPolicy* policy);
+    /// In ready queue mode, readies the task for the next scheduling pass. This is a no-op if it
+    /// is already queued, or ready queue mode is not in use.
+    void IRAM_ATTR enqueueReady();
+    /// @returns: true if tasks were readied since the last call to beginReadyPass(), or remain
+    /// ready from a pass of higher priority.
+    static bool hasReadyTasks()
+    {
+        auto& sched = threadScheduler();
+        return sched.readyPass || sched.readyTasks.load();
+    }
+    /// In ready queue mode, files the delayed task by its deadline instead of polling it
+    /// on each pass. Waking the task up, or running it, removes it again.
+    /// @param delay the remaining delay as returned by run(), in milliseconds or microseconds, check delayIsMs().
+    /// On Linux and Windows, the absolute deadline of the task is used instead.
+    void enqueueDelayed(uint32_t delay);
+    /// In ready queue mode, readies the delayed tasks whose deadline has expired for the next pass.
+    static void readyExpiredTasks();
+    /// @returns: the number of microseconds until the earliest deadline of all delayed tasks in
+    /// ready queue mode, ~0 if there are none.
+    static uint32_t nextDeadline();
+
+    /// The implementation of runCoopTasks(), for any type of reaper, onDelay and onSleep
+    /// that tests for being set like a Delegate, and can be called like it.
+    template<typename Reaper, typename OnDelay, typename OnSleep>
+    static void runTasks(const Reaper& reaper, const OnDelay& onDelay, const OnSleep& onSleep);
+
     /// Every task is entered into this list by scheduleTask(). It is removed when it exits
     /// or gets deleted.
-    static const decltype(runnableTasks)& getRunnableTasks()
+    static const RunnableTasks<CoopTaskBase>& getRunnableTasks()
     {
         return runnableTasks;
     }
@@ -204,16 +582,74 @@ public:
     /// @returns: -1: exited. 0: runnable or sleeping. >0: delayed for milliseconds or microseconds, check delayIsMs().
     int32_t run();
 
-    /// @returns: size of unused stack space. 0 if stack is not allocated yet or was deleted after task exited.
+    /// Called by runCoopTasks() when the task has exited, before the reaper.
+    /// @returns: true if the task was taken back for reuse, for instance by its CoopTaskPool.
+    /// It must then neither be reaped nor deleted.
+    virtual bool recycle() noexcept { return false; }
+
+    /// @returns: size of unused stack space, below the low water mark sampled at each yield,
+    /// 0 if stack is not allocated yet or was deleted after task exited.
+    /// The mark is lowered by a scan of a fixed band of words below it, in constant time. Frames that went
+    /// deeper between yields, and beyond the band, are missed, such that the free space may be overstated;
+    /// repeated calls lower the mark further, as long as the touched words lie within the band of each other.
+    /// Use getPeakStack() for the exact value.
     size_t getFreeStack() const;
+    /// @returns: the exact peak stack usage so far, 0 if the task has not run yet, or this cannot be measured.
+    /// The scan takes time in proportion to the free space. For a restarted task, the peak of its
+    /// previous runs may be included.
+    size_t getPeakStack() const;
 
     bool delayIsMs() const noexcept { return delay_ms; }
 
+    /// @returns: the priority that orders the task in ready queue mode, the higher of basePriority()
+    /// and the priority inherited from the tasks that wait on a CoopMutex that this task holds.
+    uint8_t priority() const noexcept { return taskPriority > inheritedPriority ? taskPriority : inheritedPriority; }
+    /// @returns: the priority set by setPriority(), 0 by default.
+    uint8_t basePriority() const noexcept { return taskPriority; }
+    /// In ready queue mode, with the default CoopFixedPriorityPolicy, a scheduling pass only runs the
+    /// ready tasks of the highest priority among them, in FIFO order. The tasks of lower priority run
+    /// in the first pass that has no ready tasks of higher priority, such that they starve as long
+    /// as those keep being ready.
+    /// In the default scheduler mode, priorities have no effect.
+    /// Use only from the thread running the CoopTasks.
+    /// @param prio the base priority, higher values run first.
+    void setPriority(uint8_t prio) noexcept;
+    /// @returns: the share of run time of the task relative to the others, 1 by default.
+    uint8_t weight() const noexcept { return taskWeight; }
+    /// In ready queue mode with CoopWeightedFairPolicy, busy tasks share the CPU in proportion
+    /// to their weights.
+    /// @param weight the relative share of run time, 0 is taken as 1.
+    void setWeight(uint8_t weight) noexcept { taskWeight = weight ? weight : 1; }
+
+#if !defined(ARDUINO)
+    /// @returns: the time of the clock that delays and timeouts are measured against, in nanoseconds.
+    static uint64_t now() { return clockSource(); }
+    /// @returns: the time of std::chrono::steady_clock in nanoseconds, the default clock.
+    static uint64_t steadyClock();
+    /// Selects the clock that delays and timeouts are measured against, for instance a
+    /// CoopManualClock in tests. This should be done before the first CoopTask is created,
+    /// and not changed thereafter during runtime.
+    /// @param source a function that returns monotonic time in nanoseconds, nullptr selects steadyClock().
+    static void useClock(ClockSource source)
+    {
+        clockSource = source ? source : steadyClock;
+    }
+    static bool usingSteadyClock()
+    {
+        return clockSource == steadyClock;
+    }
+#endif
+
     /// Modifies the sleep flag. if called from a running task, it is not immediately suspended.
     /// @param state true: a suspended task becomes sleeping, if call from the running task,
     /// the next call to yield() or delay() puts it into sleeping state.
     /// false: clears the sleeping and delay state of the task.
     void IRAM_ATTR sleep(const bool state) noexcept;
+    /// Sets the sleep flag like sleep(true), with a timeout: the sleeping task also wakes up once
+    /// ms milliseconds have passed, unless scheduleTask(true) or wakeup() wake it up before.
+    /// sleep(false) only clears the flags, in ready queue mode the task stays delayed until the timeout.
+    /// Use only for the running task, the next call to yield() suspends it.
+    void sleepFor(uint32_t ms) noexcept;
 
 #ifdef ESP32_FREERTOS
     /// @returns: a pointer to the CoopTask instance that is running. nullptr if not called from a CoopTask function (running() == false).
@@ -227,6 +663,7 @@ public:
 
     /// @returns: true if the task's is set to sleep.
     /// For a non-running task, this implies it is also currently not scheduled.
+    /// A task that is both sleeping() and delayed() is in the timed sleep of sleepFor().
     inline bool IRAM_ATTR sleeping() const noexcept __attribute__((always_inline)) { return sleeps.load(); }
     inline bool IRAM_ATTR delayed() const noexcept __attribute__((always_inline)) { return delays.load(); }
     inline bool IRAM_ATTR suspended() const noexcept __attribute__((always_inline)) { return sleeps.load() || delays.load(); }
@@ -250,7 +687,127 @@ public:
 #ifndef ARDUINO
 inline void yield() { CoopTaskBase::yield(); }
 inline void delay(uint32_t ms) { CoopTaskBase::delay(ms); }
+
+/// A manually advanced clock, for deterministic tests of delays and timeouts.
+/// Select it by CoopTaskBase::useClock(CoopManualClock::now).
+class CoopManualClock
+{
+public:
+    static uint64_t now() { return time.load(); }
+    /// @param ns the new time in nanoseconds, it must not be earlier than now().
+    static void set(uint64_t ns) { time.store(ns); }
+    static void advance(uint64_t ns) { time += ns; }
+
+private:
+    static std::atomic<uint64_t> time;
+};
+#endif
+
+template<typename Reaper, typename OnDelay, typename OnSleep>
+void CoopTaskBase::runTasks(const Reaper& reaper, const OnDelay& onDelay, const OnSleep& onSleep)
+{
+    RunState state;
+    beginRun(state);
+    if (readyQueueMode())
+    {
+        readyExpiredTasks();
+#if defined(ARDUINO)
+        beginReadyPass();
+#else
+        if (!beginReadyPass() && stealReadyTasks()) beginReadyPass();
+#endif
+        while (auto task = nextReadyTask())
+        {
+#if defined(ESP8266) || defined(ESP32)
+            optimistic_yield(10000);
+#endif
+            auto runResult = task->run();
+            readyTaskRan(task);
+            if (runResult < 0)
+            {
+                state.reaped = true;
+                if (!task->recycle() && reaper) reaper(task);
+            }
+            else if (task->delayed())
+            {
+                task->enqueueDelayed(static_cast<uint32_t>(runResult));
+            }
+            else if (!task->sleeping())
+            {
+                task->enqueuePass();
+            }
+        }
+        if (hasReadyTasks())
+        {
+            state.allSleeping = false;
+            state.minDelay_ms = 0;
+            state.minDelay_us = 0;
+        }
+        else
+        {
+            const uint32_t delay_us = nextDeadline();
+            if (~delay_us)
+            {
+                state.allSleeping = false;
+                state.minDelay_ms = delay_us / 1000UL;
+                state.minDelay_us = delay_us;
+            }
+        }
+    }
+    else
+    {
+        auto taskCount = getRunnableTasksCount();
+        for (size_t i = 0; taskCount && i < getRunnableTasks().size(); ++i)
+        {
+#if defined(ESP8266) || defined(ESP32)
+            optimistic_yield(10000);
 #endif
+            auto task = getRunnableTasks()[i].load();
+            if (task)
+            {
+                --taskCount;
+                auto runResult = task->run();
+                if (runResult < 0)
+                {
+                    state.reaped = true;
+                    if (!task->recycle() && reaper) reaper(task);
+                }
+                else if (state.minDelay_us)
+                {
+                    if (task->delayed())
+                    {
+                        state.allSleeping = false;
+                        uint32_t delay_ms = task->delayIsMs() ? static_cast<uint32_t>(runResult) : static_cast<uint32_t>(runResult) / 1000UL;
+                        if (delay_ms < state.minDelay_ms)
+                            state.minDelay_ms = delay_ms;
+                        uint32_t delay_us = !task->delayIsMs() ? static_cast<uint32_t>(runResult) :
+                            delay_ms >= (~static_cast<uint32_t>(0) >> 1) / 1000UL ? ~static_cast<uint32_t>(0) >> 1 : delay_ms * 1000UL;
+                        if (delay_us < state.minDelay_us)
+                            state.minDelay_us = delay_us;
+                    }
+                    else if (!task->sleeping())
+                    {
+                        state.allSleeping = false;
+                        state.minDelay_ms = 0;
+                        state.minDelay_us = 0;
+                    }
+                }
+            }
+        }
+    }
+    endPass(state);
+
+    bool cleanup = true;
+    if (state.allSleeping && onSleep)
+    {
+        cleanup = onSleep();
+    }
+    else if (state.minDelay_ms && onDelay)
+    {
+        cleanup = onDelay(state.minDelay_ms);
+    }
+    if (cleanup) idleRun(state);
+}
 
 /// An optional convenience funtion that does all the work to cyclically perform CoopTask execution.
 /// @param reaper An optional function that is called once when a task exits.
@@ -264,7 +821,27 @@ inline void delay(uint32_t ms) { CoopTaskBase::delay(ms); }
 /// This can be used for power saving modes.
 /// onSleep(), like onDelay(), must return a bool value, if true, runCoopTasks performs the
 /// default housekeeping actions, otherwise it skips those.
+/// On Linux, in blocking idle mode, see CoopTaskBase::useBlockingIdle(), the default housekeeping of an
+/// idle pass waits on a futex, with FUTEX_WAIT_BITSET, until shortly
+/// before the earliest deadline, taken as an absolute time on CLOCK_MONOTONIC at the end of the pass.
+/// scheduleTask(), for instance by CoopSemaphore::post(), ends that wait early.
+/// Hooks that may return before the delay has passed, for instance on I/O events, should return false.
 void runCoopTasks(const Delegate<void(const CoopTaskBase* const task)>& reaper = nullptr,
     const Delegate<bool(uint32_t ms)>& onDelay = nullptr, const Delegate<bool()>& onSleep = nullptr);
 
+#if !defined(ARDUINO) || defined(ESP8266) || defined(ESP32)
+/// Like runCoopTasks() with Delegate hooks, but calls the hooks that are passed as StaticDelegate
+/// directly, such that they get inlined. Each hook is either a StaticDelegate or nullptr, for instance
+/// runCoopTasks(makeStaticDelegate(reaper), nullptr, makeStaticDelegate(onSleep)).
+template<typename Reaper, typename OnDelay = std::nullptr_t, typename OnSleep = std::nullptr_t,
+    typename = typename std::enable_if<delegate::detail::IsStaticDelegateOrNull<Reaper>::value &&
+    delegate::detail::IsStaticDelegateOrNull<OnDelay>::value && delegate::detail::IsStaticDelegateOrNull<OnSleep>::value &&
+    !(std::is_same<Reaper, std::nullptr_t>::value && std::is_same<OnDelay, std::nullptr_t>::value &&
+        std::is_same<OnSleep, std::nullptr_t>::value)>::type>
+void runCoopTasks(const Reaper& reaper, const OnDelay& onDelay = nullptr, const OnSleep& onSleep = nullptr)
+{
+    CoopTaskBase::runTasks(toStaticDelegate(reaper), toStaticDelegate(onDelay), toStaticDelegate(onSleep));
+}
+#endif
+
 #endif // __CoopTaskBase_h
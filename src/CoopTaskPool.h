@@ -0,0 +1,130 @@
+/*
+CoopTaskPool.h - Implementation of a pool of reusable cooperative scheduling tasks
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __CoopTaskPool_h
+#define __CoopTaskPool_h
+
+#include "CoopTask.h"
+
+/// A fixed number of CoopTask instances, constructed with their stacks up front, that run
+/// task functions passed to spawn(). When a task function returns or calls exit(), runCoopTasks()
+/// puts its task back into the pool instead of handing it to the reaper, such that spawning
+/// a task neither allocates the CoopTask nor its stack.
+/// Pooled tasks are owned by the pool and must not be deleted. spawn() and runCoopTasks()
+/// for the pooled tasks must be called from the same thread.
+template<class StackAllocator = CoopTaskStackAllocator> class CoopTaskPool
+{
+public:
+    using taskfunction_t = typename CoopTask<void, StackAllocator>::taskfunction_t;
+
+    class Task : public CoopTask<void, StackAllocator>
+    {
+    public:
+#if defined(ARDUINO)
+        Task(CoopTaskPool& _pool, const String& name, size_t stackSize) :
+#else
+        Task(CoopTaskPool& _pool, const std::string& name, size_t stackSize) :
+#endif
+            CoopTask<void, StackAllocator>(name, nullptr, stackSize), pool(_pool)
+        {
+        }
+
+        bool recycle() noexcept override
+        {
+            pool.release(this);
+            return true;
+        }
+
+    protected:
+        friend class CoopTaskPool;
+        CoopTaskPool& pool;
+        // links all tasks of the pool
+        Task* poolNext = nullptr;
+        // links the tasks that are available for spawn()
+        Task* freeNext = nullptr;
+    };
+
+    /// @param count the number of tasks to construct, size() is less if stack allocation fails.
+#if defined(ARDUINO)
+    CoopTaskPool(const String& name, size_t count, size_t stackSize = CoopTaskBase::DEFAULTTASKSTACKSIZE)
+#else
+    CoopTaskPool(const std::string& name, size_t count, size_t stackSize = CoopTaskBase::DEFAULTTASKSTACKSIZE)
+#endif
+    {
+        for (; tasksCount < count; ++tasksCount)
+        {
+            auto task = new Task(*this, name, stackSize);
+            if (!task) break;
+            if (!*task)
+            {
+                delete task;
+                break;
+            }
+            task->poolNext = tasks;
+            tasks = task;
+            release(task);
+        }
+    }
+    CoopTaskPool(const CoopTaskPool&) = delete;
+    CoopTaskPool& operator=(const CoopTaskPool&) = delete;
+    /// Deletes all tasks of the pool, including those that have not exited yet.
+    ~CoopTaskPool()
+    {
+        while (tasks)
+        {
+            auto task = tasks;
+            tasks = task->poolNext;
+            delete task;
+        }
+    }
+
+    /// @returns: the number of tasks in the pool.
+    size_t size() const noexcept { return tasksCount; }
+    /// @returns: the number of tasks that are available for spawn().
+    size_t available() const noexcept { return freeCount; }
+
+    /// Runs the task function on an available task of the pool, and schedules it.
+    /// @returns: the task, or nullptr if all tasks of the pool are in use.
+    Task* spawn(taskfunction_t func)
+    {
+        auto task = freeTasks;
+        if (!task) return nullptr;
+        freeTasks = task->freeNext;
+        --freeCount;
+        task->freeNext = nullptr;
+        if (task->restart(func) && task->scheduleTask()) return task;
+        release(task);
+        return nullptr;
+    }
+
+protected:
+    Task* tasks = nullptr;
+    Task* freeTasks = nullptr;
+    size_t tasksCount = 0;
+    size_t freeCount = 0;
+
+    void release(Task* task) noexcept
+    {
+        task->freeNext = freeTasks;
+        freeTasks = task;
+        ++freeCount;
+    }
+};
+
+#endif // __CoopTaskPool_h
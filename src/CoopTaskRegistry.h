@@ -0,0 +1,100 @@
+/*
+CoopTaskRegistry.h - Implementation of a growable registry for cooperative scheduling tasks
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __CoopTaskRegistry_h
+#define __CoopTaskRegistry_h
+
+#include <atomic>
+#include <new>
+
+/*!
+    @brief	A growable array of atomic task pointers, organized as a directory of fixed size segments.
+            Segments are allocated on demand and never move or get freed during runtime, such that
+            slots can be indexed, inserted into, and cleared lock-free while the registry grows.
+*/
+template< typename T, size_t SegmentSize = 256, size_t MaxSegments = 4096 >
+class CoopTaskRegistry
+{
+public:
+    using value_type = std::atomic<T*>;
+
+    CoopTaskRegistry() : m_segmentsCount(0)
+    {
+        for (size_t i = 0; i < MaxSegments; ++i) m_segments[i].store(nullptr, std::memory_order_relaxed);
+    }
+    CoopTaskRegistry(const CoopTaskRegistry&) = delete;
+    CoopTaskRegistry& operator=(const CoopTaskRegistry&) = delete;
+    ~CoopTaskRegistry()
+    {
+        for (size_t i = 0; i < MaxSegments; ++i) delete[] m_segments[i].load();
+    }
+
+    /*!
+        @brief	Get the number of slots that can currently be indexed.
+    */
+    size_t size() const
+    {
+        return m_segmentsCount.load(std::memory_order_acquire) * SegmentSize;
+    }
+
+    /*!
+        @brief	Get the maximum number of slots the registry can grow to.
+    */
+    static constexpr size_t max_size()
+    {
+        return SegmentSize * MaxSegments;
+    }
+
+    value_type& operator[](size_t i)
+    {
+        return m_segments[i / SegmentSize].load(std::memory_order_relaxed)[i % SegmentSize];
+    }
+    const value_type& operator[](size_t i) const
+    {
+        return m_segments[i / SegmentSize].load(std::memory_order_relaxed)[i % SegmentSize];
+    }
+
+    /*!
+        @brief	Append another segment of empty slots. Safe for concurrent callers,
+                the registry grows by at least one segment on success.
+        @return true if size() has grown since the call, false if the maximum size is
+                reached or allocation failed.
+    */
+    bool grow()
+    {
+        const auto count = m_segmentsCount.load(std::memory_order_acquire);
+        if (count >= MaxSegments) return false;
+        if (!m_segments[count].load(std::memory_order_acquire))
+        {
+            auto segment = new (std::nothrow) value_type[SegmentSize]();
+            if (!segment) return false;
+            value_type* expected = nullptr;
+            if (!m_segments[count].compare_exchange_strong(expected, segment)) delete[] segment;
+        }
+        auto expected = count;
+        m_segmentsCount.compare_exchange_strong(expected, count + 1);
+        return true;
+    }
+
+protected:
+    std::atomic<value_type*> m_segments[MaxSegments];
+    std::atomic<size_t> m_segmentsCount;
+};
+
+#endif // __CoopTaskRegistry_h
@@ -0,0 +1,97 @@
+/*
+CoopWaitList.h - Implementation of an intrusive wait list for cooperative scheduling tasks
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __CoopWaitList_h
+#define __CoopWaitList_h
+
+#include "CoopTaskBase.h"
+
+/// A FIFO of tasks waiting on a synchronization object, doubly linked through members of
+/// CoopTaskBase, such that linking a task never allocates or fails, and a task is removed
+/// from anywhere in the list in constant time. A task is in at most one wait list at a time,
+/// a task that is deleted leaves its wait list.
+/// The list is not synchronized, it must only be used from the thread running the CoopTasks.
+class CoopWaitList
+{
+public:
+    CoopWaitList() = default;
+    CoopWaitList(const CoopWaitList&) = delete;
+    CoopWaitList& operator=(const CoopWaitList&) = delete;
+    ~CoopWaitList()
+    {
+        while (pop_front()) {}
+    }
+
+    bool empty() const noexcept { return !head; }
+    /// @returns: the number of tasks in the list.
+    size_t size() const noexcept { return count; }
+    /// @returns: the task that has been waiting longest, or nullptr if the list is empty.
+    CoopTaskBase* front() const noexcept { return head; }
+    /// @returns: the task that has been waiting next after task, which must be in this list,
+    /// or nullptr if task is the last one.
+    CoopTaskBase* next(const CoopTaskBase* task) const noexcept { return task->waitNext; }
+    /// @returns: true if task is linked into this list.
+    bool contains(const CoopTaskBase* task) const noexcept { return task->waitList == this; }
+
+    /// Appends task to the end of the list, unless it is already in this list.
+    /// @returns: true if task is in this list, false if it is in another wait list.
+    bool push_back(CoopTaskBase* task) noexcept
+    {
+        if (task->waitList) return task->waitList == this;
+        task->waitList = this;
+        task->waitPrev = tail;
+        task->waitNext = nullptr;
+        if (tail) tail->waitNext = task;
+        else head = task;
+        tail = task;
+        ++count;
+        return true;
+    }
+
+    /// Removes the task that has been waiting longest.
+    /// @returns: the removed task, or nullptr if the list is empty.
+    CoopTaskBase* pop_front() noexcept
+    {
+        auto task = head;
+        if (task) remove(task);
+        return task;
+    }
+
+    /// @returns: true if task was in this list and is removed, otherwise false.
+    bool remove(CoopTaskBase* task) noexcept
+    {
+        if (task->waitList != this) return false;
+        if (task->waitPrev) task->waitPrev->waitNext = task->waitNext;
+        else head = task->waitNext;
+        if (task->waitNext) task->waitNext->waitPrev = task->waitPrev;
+        else tail = task->waitPrev;
+        task->waitList = nullptr;
+        task->waitPrev = nullptr;
+        task->waitNext = nullptr;
+        --count;
+        return true;
+    }
+
+protected:
+    CoopTaskBase* head = nullptr;
+    CoopTaskBase* tail = nullptr;
+    size_t count = 0;
+};
+
+#endif // __CoopWaitList_h
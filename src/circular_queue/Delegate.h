@@ -31,6 +31,17 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #if !defined(ARDUINO) || defined(ESP8266) || defined(ESP32)
 #include <functional>
 #include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Capturing lambdas and other function objects up to this size are stored inside the Delegate.
+#ifndef DELEGATE_INLINE_CAPACITY
+#define DELEGATE_INLINE_CAPACITY (4 * sizeof(void*))
+#endif
+// Define DELEGATE_INLINE_ONLY to turn larger function objects, which are otherwise copied
+// to the heap, into compile time errors.
 #else
 #include "circular_queue/ghostl.h"
 #endif
@@ -53,6 +64,185 @@ namespace delegate
     {
 
 #if !defined(ARDUINO) || defined(ESP8266) || defined(ESP32)
+        template<typename T> class Callable;
+
+        /// Holds any function object like std::function does, but stores those that fit into
+        /// DELEGATE_INLINE_CAPACITY bytes, and can be moved without throwing, in place.
+        template<typename R, typename... P>
+        class Callable<R(P...)> {
+        public:
+            static constexpr size_t capacity = DELEGATE_INLINE_CAPACITY;
+
+            template<typename F> static constexpr bool fitsInline()
+            {
+                return sizeof(F) <= capacity && alignof(F) <= alignof(std::max_align_t) &&
+                    std::is_nothrow_move_constructible<F>::value;
+            }
+
+            Callable() noexcept : invoker(nullptr), manager(nullptr) {}
+
+            Callable(std::nullptr_t) noexcept : invoker(nullptr), manager(nullptr) {}
+
+            Callable(const Callable& other) : invoker(nullptr), manager(nullptr)
+            {
+                if (other.manager) other.manager(COPY, this, const_cast<Callable*>(&other));
+            }
+
+            Callable(Callable&& other) noexcept : invoker(nullptr), manager(nullptr)
+            {
+                if (other.manager) other.manager(MOVE, this, &other);
+            }
+
+            template<typename F, typename Fn = typename std::decay<F>::type,
+                typename = typename std::enable_if<!std::is_same<Fn, Callable>::value>::type>
+            Callable(F&& f) : invoker(nullptr), manager(nullptr)
+            {
+#if defined(DELEGATE_INLINE_ONLY)
+                static_assert(fitsInline<Fn>(), "function object exceeds DELEGATE_INLINE_CAPACITY");
+#endif
+                if (isNull(f)) return;
+                store<Fn>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Fn>()>());
+            }
+
+            ~Callable()
+            {
+                if (manager) manager(DESTROY, nullptr, this);
+            }
+
+            Callable& operator=(const Callable& other)
+            {
+                if (this != &other)
+                {
+                    Callable copy(other);
+                    *this = std::move(copy);
+                }
+                return *this;
+            }
+
+            Callable& operator=(Callable&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    if (manager) manager(DESTROY, nullptr, this);
+                    invoker = nullptr;
+                    manager = nullptr;
+                    if (other.manager) other.manager(MOVE, this, &other);
+                }
+                return *this;
+            }
+
+            explicit operator bool() const noexcept
+            {
+                return invoker;
+            }
+
+            R IRAM_ATTR operator()(P... args) const
+            {
+                // calling an empty Callable fails like calling an empty std::function
+                if (!invoker)
+                {
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+                    throw std::bad_function_call();
+#else
+                    abort();
+#endif
+                }
+                return invoker(const_cast<Callable*>(this), std::forward<P>(args)...);
+            }
+
+        protected:
+            enum Op { COPY, MOVE, DESTROY };
+
+            template<typename F> static auto isNull(const F& f) -> decltype(f == nullptr)
+            {
+                return f == nullptr;
+            }
+            static bool isNull(...)
+            {
+                return false;
+            }
+
+            template<typename Fn> Fn* target(std::true_type) noexcept
+            {
+                return reinterpret_cast<Fn*>(&storage);
+            }
+
+            template<typename Fn> Fn* target(std::false_type) noexcept
+            {
+                return *reinterpret_cast<Fn**>(&storage);
+            }
+
+            template<typename Fn> Fn* target() noexcept
+            {
+                return target<Fn>(std::integral_constant<bool, fitsInline<Fn>()>());
+            }
+
+            template<typename Fn, typename F> void store(F&& f, std::true_type)
+            {
+                new (&storage) Fn(std::forward<F>(f));
+                invoker = invoke<Fn>;
+                manager = manage<Fn>;
+            }
+
+            template<typename Fn, typename F> void store(F&& f, std::false_type)
+            {
+                *reinterpret_cast<Fn**>(&storage) = new Fn(std::forward<F>(f));
+                invoker = invoke<Fn>;
+                manager = manage<Fn>;
+            }
+
+            template<typename Fn> void moveFrom(Callable* src, std::true_type) noexcept
+            {
+                new (&storage) Fn(std::move(*src->template target<Fn>()));
+                src->template target<Fn>()->~Fn();
+            }
+
+            template<typename Fn> void moveFrom(Callable* src, std::false_type) noexcept
+            {
+                *reinterpret_cast<Fn**>(&storage) = src->template target<Fn>();
+            }
+
+            template<typename Fn> void destroy(std::true_type) noexcept
+            {
+                target<Fn>()->~Fn();
+            }
+
+            template<typename Fn> void destroy(std::false_type) noexcept
+            {
+                delete target<Fn>();
+            }
+
+            template<typename Fn> static R IRAM_ATTR invoke(Callable* self, P... args)
+            {
+                return (*self->template target<Fn>())(std::forward<P>(args)...);
+            }
+
+            template<typename Fn> static void manage(Op op, Callable* dst, Callable* src)
+            {
+                using inlined = std::integral_constant<bool, fitsInline<Fn>()>;
+                switch (op)
+                {
+                case COPY:
+                    dst->template store<Fn>(static_cast<const Fn&>(*src->template target<Fn>()), inlined());
+                    break;
+                case MOVE:
+                    dst->template moveFrom<Fn>(src, inlined());
+                    dst->invoker = src->invoker;
+                    dst->manager = src->manager;
+                    src->invoker = nullptr;
+                    src->manager = nullptr;
+                    break;
+                case DESTROY:
+                    src->template destroy<Fn>(inlined());
+                    break;
+                }
+            }
+
+            typename std::aligned_storage<(capacity < sizeof(void*) ? sizeof(void*) : capacity), alignof(std::max_align_t)>::type storage;
+            R(*invoker)(Callable*, P...);
+            void (*manager)(Op, Callable*, Callable*);
+        };
+
         template<typename A, typename R, typename... P>
         class DelegatePImpl {
         public:
@@ -62,6 +252,7 @@ namespace delegate
             using FunAPtr = R(*)(A, P...);
             using FunVPPtr = R(*)(void*, P...);
             using FunctionType = std::function<target_type>;
+            using CallableType = Callable<target_type>;
         public:
             DelegatePImpl()
             {
@@ -78,7 +269,7 @@ namespace delegate
             ~DelegatePImpl()
             {
                 if (FUNC == kind)
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 else if (FPA == kind)
                     obj.~A();
             }
@@ -88,7 +279,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(del.functional);
+                    new (&functional) CallableType(del.functional);
                 }
                 else if (FPA == del.kind)
                 {
@@ -106,7 +297,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(std::move(del.functional));
+                    new (&functional) CallableType(std::move(del.functional));
                 }
                 else if (FPA == del.kind)
                 {
@@ -142,7 +333,7 @@ namespace delegate
             template<typename F> DelegatePImpl(F functional)
             {
                 kind = FUNC;
-                new (&this->functional) FunctionType(std::forward<F>(functional));
+                new (&this->functional) CallableType(std::forward<F>(functional));
             }
 
             DelegatePImpl& operator=(const DelegatePImpl& del)
@@ -152,7 +343,7 @@ namespace delegate
                 {
                     if (FUNC == kind)
                     {
-                        functional.~FunctionType();
+                        functional.~CallableType();
                     }
                     else if (FPA == kind)
                     {
@@ -160,7 +351,7 @@ namespace delegate
                     }
                     if (FUNC == del.kind)
                     {
-                        new (&this->functional) FunctionType();
+                        new (&this->functional) CallableType();
                     }
                     else if (FPA == del.kind)
                     {
@@ -191,7 +382,7 @@ namespace delegate
                 {
                     if (FUNC == kind)
                     {
-                        functional.~FunctionType();
+                        functional.~CallableType();
                     }
                     else if (FPA == kind)
                     {
@@ -199,7 +390,7 @@ namespace delegate
                     }
                     if (FUNC == del.kind)
                     {
-                        new (&this->functional) FunctionType();
+                        new (&this->functional) CallableType();
                     }
                     else if (FPA == del.kind)
                     {
@@ -227,7 +418,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FPA == kind)
                 {
@@ -242,7 +433,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FPA == kind)
                 {
@@ -319,7 +510,8 @@ namespace delegate
                 }
                 else
                 {
-                    return functional;
+                    // a null functional converts to an empty FunctionType, like std::function
+                    return functional ? FunctionType(functional) : FunctionType();
                 }
             }
 
@@ -341,7 +533,7 @@ namespace delegate
 
         protected:
             union {
-                FunctionType functional;
+                CallableType functional;
                 FunPtr fn;
                 struct {
                     FunAPtr fnA;
@@ -567,6 +759,7 @@ namespace delegate
         protected:
             using FunPtr = target_type*;
             using FunctionType = std::function<target_type>;
+            using CallableType = Callable<target_type>;
             using FunVPPtr = R(*)(void*, P...);
         public:
             DelegatePImpl()
@@ -584,7 +777,7 @@ namespace delegate
             ~DelegatePImpl()
             {
                 if (FUNC == kind)
-                    functional.~FunctionType();
+                    functional.~CallableType();
             }
 
             DelegatePImpl(const DelegatePImpl& del)
@@ -592,7 +785,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(del.functional);
+                    new (&functional) CallableType(del.functional);
                 }
                 else
                 {
@@ -605,7 +798,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(std::move(del.functional));
+                    new (&functional) CallableType(std::move(del.functional));
                 }
                 else
                 {
@@ -622,7 +815,7 @@ namespace delegate
             template<typename F> DelegatePImpl(F functional)
             {
                 kind = FUNC;
-                new (&this->functional) FunctionType(std::forward<F>(functional));
+                new (&this->functional) CallableType(std::forward<F>(functional));
             }
 
             DelegatePImpl& operator=(const DelegatePImpl& del)
@@ -630,11 +823,11 @@ namespace delegate
                 if (this == &del) return *this;
                 if (FUNC == kind && FUNC != del.kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FUNC != kind && FUNC == del.kind)
                 {
-                    new (&this->functional) FunctionType();
+                    new (&this->functional) CallableType();
                 }
                 kind = del.kind;
                 if (FUNC == del.kind)
@@ -653,11 +846,11 @@ namespace delegate
                 if (this == &del) return *this;
                 if (FUNC == kind && FUNC != del.kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FUNC != kind && FUNC == del.kind)
                 {
-                    new (&this->functional) FunctionType();
+                    new (&this->functional) CallableType();
                 }
                 kind = del.kind;
                 if (FUNC == del.kind)
@@ -675,7 +868,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                     kind = FP;
                 }
                 DelegatePImpl::fn = fn;
@@ -686,7 +879,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 kind = FP;
                 fn = nullptr;
@@ -740,7 +933,8 @@ namespace delegate
                 }
                 else
                 {
-                    return functional;
+                    // a null functional converts to an empty FunctionType, like std::function
+                    return functional ? FunctionType(functional) : FunctionType();
                 }
             }
 
@@ -758,7 +952,7 @@ namespace delegate
 
         protected:
             union {
-                FunctionType functional;
+                CallableType functional;
                 FunPtr fn;
             };
             enum { FUNC, FP } kind;
@@ -862,6 +1056,7 @@ namespace delegate
             using FunPtr = target_type*;
             using FunAPtr = R(*)(A);
             using FunctionType = std::function<target_type>;
+            using CallableType = Callable<target_type>;
             using FunVPPtr = R(*)(void*);
         public:
             DelegateImpl()
@@ -879,7 +1074,7 @@ namespace delegate
             ~DelegateImpl()
             {
                 if (FUNC == kind)
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 else if (FPA == kind)
                     obj.~A();
             }
@@ -889,7 +1084,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(del.functional);
+                    new (&functional) CallableType(del.functional);
                 }
                 else if (FPA == del.kind)
                 {
@@ -907,7 +1102,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(std::move(del.functional));
+                    new (&functional) CallableType(std::move(del.functional));
                 }
                 else if (FPA == del.kind)
                 {
@@ -943,7 +1138,7 @@ namespace delegate
             template<typename F> DelegateImpl(F functional)
             {
                 kind = FUNC;
-                new (&this->functional) FunctionType(std::forward<F>(functional));
+                new (&this->functional) CallableType(std::forward<F>(functional));
             }
 
             DelegateImpl& operator=(const DelegateImpl& del)
@@ -953,7 +1148,7 @@ namespace delegate
                 {
                     if (FUNC == kind)
                     {
-                        functional.~FunctionType();
+                        functional.~CallableType();
                     }
                     else if (FPA == kind)
                     {
@@ -961,7 +1156,7 @@ namespace delegate
                     }
                     if (FUNC == del.kind)
                     {
-                        new (&this->functional) FunctionType();
+                        new (&this->functional) CallableType();
                     }
                     else if (FPA == del.kind)
                     {
@@ -992,7 +1187,7 @@ namespace delegate
                 {
                     if (FUNC == kind)
                     {
-                        functional.~FunctionType();
+                        functional.~CallableType();
                     }
                     else if (FPA == kind)
                     {
@@ -1000,7 +1195,7 @@ namespace delegate
                     }
                     if (FUNC == del.kind)
                     {
-                        new (&this->functional) FunctionType();
+                        new (&this->functional) CallableType();
                     }
                     else if (FPA == del.kind)
                     {
@@ -1028,7 +1223,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FPA == kind)
                 {
@@ -1043,7 +1238,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FPA == kind)
                 {
@@ -1119,7 +1314,8 @@ namespace delegate
                 }
                 else
                 {
-                    return functional;
+                    // a null functional converts to an empty FunctionType, like std::function
+                    return functional ? FunctionType(functional) : FunctionType();
                 }
             }
 
@@ -1141,7 +1337,7 @@ namespace delegate
 
         protected:
             union {
-                FunctionType functional;
+                CallableType functional;
                 FunPtr fn;
                 struct {
                     FunAPtr fnA;
@@ -1366,6 +1562,7 @@ namespace delegate
         protected:
             using FunPtr = target_type*;
             using FunctionType = std::function<target_type>;
+            using CallableType = Callable<target_type>;
             using FunVPPtr = R(*)(void*);
         public:
             DelegateImpl()
@@ -1383,7 +1580,7 @@ namespace delegate
             ~DelegateImpl()
             {
                 if (FUNC == kind)
-                    functional.~FunctionType();
+                    functional.~CallableType();
             }
 
             DelegateImpl(const DelegateImpl& del)
@@ -1391,7 +1588,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(del.functional);
+                    new (&functional) CallableType(del.functional);
                 }
                 else
                 {
@@ -1404,7 +1601,7 @@ namespace delegate
                 kind = del.kind;
                 if (FUNC == del.kind)
                 {
-                    new (&functional) FunctionType(std::move(del.functional));
+                    new (&functional) CallableType(std::move(del.functional));
                 }
                 else
                 {
@@ -1421,7 +1618,7 @@ namespace delegate
             template<typename F> DelegateImpl(F functional)
             {
                 kind = FUNC;
-                new (&this->functional) FunctionType(std::forward<F>(functional));
+                new (&this->functional) CallableType(std::forward<F>(functional));
             }
 
             DelegateImpl& operator=(const DelegateImpl& del)
@@ -1429,11 +1626,11 @@ namespace delegate
                 if (this == &del) return *this;
                 if (FUNC == kind && FUNC != del.kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FUNC != kind && FUNC == del.kind)
                 {
-                    new (&this->functional) FunctionType();
+                    new (&this->functional) CallableType();
                 }
                 kind = del.kind;
                 if (FUNC == del.kind)
@@ -1452,11 +1649,11 @@ namespace delegate
                 if (this == &del) return *this;
                 if (FUNC == kind && FUNC != del.kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 else if (FUNC != kind && FUNC == del.kind)
                 {
-                    new (&this->functional) FunctionType();
+                    new (&this->functional) CallableType();
                 }
                 kind = del.kind;
                 if (FUNC == del.kind)
@@ -1474,7 +1671,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                     kind = FP;
                 }
                 DelegateImpl::fn = fn;
@@ -1485,7 +1682,7 @@ namespace delegate
             {
                 if (FUNC == kind)
                 {
-                    functional.~FunctionType();
+                    functional.~CallableType();
                 }
                 kind = FP;
                 fn = nullptr;
@@ -1539,7 +1736,8 @@ namespace delegate
                 }
                 else
                 {
-                    return functional;
+                    // a null functional converts to an empty FunctionType, like std::function
+                    return functional ? FunctionType(functional) : FunctionType();
                 }
             }
 
@@ -1557,7 +1755,7 @@ namespace delegate
 
         protected:
             union {
-                FunctionType functional;
+                CallableType functional;
                 FunPtr fn;
             };
             enum { FUNC, FP } kind;
@@ -2127,4 +2325,78 @@ public:
     }
 };
 
+#if !defined(ARDUINO) || defined(ESP8266) || defined(ESP32)
+/// A function object of type F, that is called directly instead of through the type erasure
+/// of Delegate, such that the call can be inlined. It tests false if F converts to false, like
+/// an empty Delegate or a null function pointer, and StaticDelegate<std::nullptr_t> is always empty.
+template<typename F> class StaticDelegate
+{
+public:
+    StaticDelegate(const F& f) : fn(f) {}
+    StaticDelegate(F&& f) : fn(std::move(f)) {}
+
+    explicit operator bool() const
+    {
+        return isSet(fn, 0);
+    }
+
+    template<typename... P> auto IRAM_ATTR operator()(P&&... args) const -> decltype(std::declval<F&>()(std::forward<P>(args)...))
+    {
+        return fn(std::forward<P>(args)...);
+    }
+
+protected:
+    template<typename T> static auto isSet(const T& f, int) -> decltype(static_cast<bool>(f))
+    {
+        return static_cast<bool>(f);
+    }
+    template<typename T> static bool isSet(const T&, long)
+    {
+        return true;
+    }
+
+    mutable F fn;
+};
+
+template<> class StaticDelegate<std::nullptr_t>
+{
+public:
+    StaticDelegate(std::nullptr_t = nullptr) {}
+
+    explicit constexpr operator bool() const
+    {
+        return false;
+    }
+
+    template<typename... P> bool operator()(P&&...) const
+    {
+        return false;
+    }
+};
+
+template<typename F> StaticDelegate<typename std::decay<F>::type> makeStaticDelegate(F&& f)
+{
+    return StaticDelegate<typename std::decay<F>::type>(std::forward<F>(f));
+}
+
+template<typename F> const StaticDelegate<F>& toStaticDelegate(const StaticDelegate<F>& f)
+{
+    return f;
+}
+
+inline StaticDelegate<std::nullptr_t> toStaticDelegate(std::nullptr_t)
+{
+    return nullptr;
+}
+
+namespace delegate
+{
+    namespace detail
+    {
+        template<typename T> struct IsStaticDelegateOrNull : std::is_same<T, std::nullptr_t> {};
+        template<typename F> struct IsStaticDelegateOrNull<StaticDelegate<F>> : std::true_type {};
+    }
+}
+#endif
+
 #endif // __Delegate_h
@@ -42,15 +42,19 @@ using std::min;
     @brief	Instance class for a single-producer, single-consumer circular queue / ring buffer (FIFO).
             This implementation is lock-free between producer and consumer for the available(), peek(),
             pop(), and push() type functions.
+            The producer and the consumer each keep a copy of the other's index, and only reload it
+            when the queue appears full or empty, respectively.
+            With Padded = true, the indices of producer and consumer are on separate cache lines,
+            such that a producer and consumer on different cores do not contend for the same line.
 */
-template< typename T, typename ForEachArg = void >
+template< typename T, typename ForEachArg = void, bool Padded = false >
 class circular_queue
 {
 public:
     /*!
         @brief	Constructs a valid, but zero-capacity dummy queue.
     */
-    circular_queue() : m_bufSize(1)
+    circular_queue() : m_bufSize(1), m_cachedOutPos(0), m_cachedInPos(0)
     {
         m_inPos.store(0);
         m_outPos.store(0);
@@ -58,13 +62,14 @@ public:
     /*!
         @brief  Constructs a queue of the given maximum capacity.
     */
-    circular_queue(const size_t capacity) : m_bufSize(capacity + 1), m_buffer(new T[m_bufSize])
+    circular_queue(const size_t capacity) : m_bufSize(capacity + 1), m_buffer(new T[m_bufSize]), m_cachedOutPos(0), m_cachedInPos(0)
     {
         m_inPos.store(0);
         m_outPos.store(0);
     }
     circular_queue(circular_queue&& cq) :
-        m_bufSize(cq.m_bufSize), m_buffer(cq.m_buffer), m_inPos(cq.m_inPos.load()), m_outPos(cq.m_outPos.load())
+        m_bufSize(cq.m_bufSize), m_buffer(cq.m_buffer), m_inPos(cq.m_inPos.load()), m_cachedOutPos(cq.m_cachedOutPos),
+        m_outPos(cq.m_outPos.load()), m_cachedInPos(cq.m_cachedInPos)
     {}
     ~circular_queue()
     {
@@ -76,7 +81,9 @@ public:
         m_bufSize = cq.m_bufSize;
         m_buffer = cq.m_buffer;
         m_inPos.store(cq.m_inPos.load());
+        m_cachedOutPos = cq.m_cachedOutPos;
         m_outPos.store(cq.m_outPos.load());
+        m_cachedInPos = cq.m_cachedInPos;
     }
     circular_queue& operator=(const circular_queue&) = delete;
 
@@ -102,7 +109,8 @@ public:
     */
     void flush()
     {
-        m_outPos.store(m_inPos.load());
+        m_cachedInPos = m_inPos.load();
+        m_outPos.store(m_cachedInPos);
     }
 
     /*!
@@ -157,8 +165,9 @@ public:
     {
         const auto inPos = m_inPos.load(std::memory_order_acquire);
         const size_t next = (inPos + 1) % m_bufSize;
-        if (next == m_outPos.load(std::memory_order_relaxed)) {
-            return false;
+        if (next == m_cachedOutPos) {
+            m_cachedOutPos = m_outPos.load(std::memory_order_relaxed);
+            if (next == m_cachedOutPos) return false;
         }
     
         std::atomic_thread_fence(std::memory_order_acquire);
@@ -176,8 +185,9 @@ public:
     {
         const auto inPos = m_inPos.load(std::memory_order_acquire);
         const size_t next = (inPos + 1) % m_bufSize;
-        if (next == m_outPos.load(std::memory_order_relaxed)) {
-            return false;
+        if (next == m_cachedOutPos) {
+            m_cachedOutPos = m_outPos.load(std::memory_order_relaxed);
+            if (next == m_cachedOutPos) return false;
         }
     
         std::atomic_thread_fence(std::memory_order_acquire);
@@ -251,6 +261,9 @@ public:
 #endif
 
 protected:
+    static constexpr size_t CACHELINESIZE = 64;
+    static constexpr size_t INDEXALIGNMENT = Padded ? CACHELINESIZE : alignof(std::atomic<size_t>);
+
     const T defaultValue = {};
     size_t m_bufSize;
 #if defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
@@ -258,12 +271,18 @@ protected:
 #else
     std::unique_ptr<T> m_buffer;
 #endif
-    std::atomic<size_t> m_inPos;
-    std::atomic<size_t> m_outPos;
+    // written by the producer
+    alignas(INDEXALIGNMENT) std::atomic<size_t> m_inPos;
+    // the value of m_outPos when the producer last loaded it, free slots end there at the earliest
+    size_t m_cachedOutPos;
+    // written by the consumer
+    alignas(INDEXALIGNMENT) std::atomic<size_t> m_outPos;
+    // the value of m_inPos when the consumer last loaded it, available elements end there at the earliest
+    size_t m_cachedInPos;
 };
 
-template< typename T, typename ForEachArg >
-bool circular_queue<T, ForEachArg>::capacity(const size_t cap)
+template< typename T, typename ForEachArg, bool Padded >
+bool circular_queue<T, ForEachArg, Padded>::capacity(const size_t cap)
 {
     if (cap + 1 == m_bufSize) return true;
     else if (available() > cap) return false;
@@ -271,6 +290,8 @@ bool circular_queue<T, ForEachArg>::capacity(const size_t cap)
     const auto available = pop_n(buffer, cap);
     m_buffer.reset(buffer);
     m_bufSize = cap + 1;
+    m_cachedOutPos = 0;
+    m_cachedInPos = available;
     std::atomic_thread_fence(std::memory_order_release);
     m_inPos.store(available, std::memory_order_relaxed);
     m_outPos.store(0, std::memory_order_release);
@@ -278,11 +299,12 @@ bool circular_queue<T, ForEachArg>::capacity(const size_t cap)
 }
 
 #if defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
-template< typename T, typename ForEachArg >
-size_t circular_queue<T, ForEachArg>::push_n(const T* buffer, size_t size)
+template< typename T, typename ForEachArg, bool Padded >
+size_t circular_queue<T, ForEachArg, Padded>::push_n(const T* buffer, size_t size)
 {
     const auto inPos = m_inPos.load(std::memory_order_acquire);
     const auto outPos = m_outPos.load(std::memory_order_relaxed);
+    m_cachedOutPos = outPos;
 
     size_t blockSize = (outPos > inPos) ? outPos - 1 - inPos : (outPos == 0) ? m_bufSize - 1 - inPos : m_bufSize - inPos;
     blockSize = min(size, blockSize);
@@ -305,11 +327,15 @@ size_t circular_queue<T, ForEachArg>::push_n(const T* buffer, size_t size)
 }
 #endif
 
-template< typename T, typename ForEachArg >
-T circular_queue<T, ForEachArg>::pop()
+template< typename T, typename ForEachArg, bool Padded >
+T circular_queue<T, ForEachArg, Padded>::pop()
 {
     const auto outPos = m_outPos.load(std::memory_order_acquire);
-    if (m_inPos.load(std::memory_order_relaxed) == outPos) return defaultValue;
+    if (m_cachedInPos == outPos)
+    {
+        m_cachedInPos = m_inPos.load(std::memory_order_relaxed);
+        if (m_cachedInPos == outPos) return defaultValue;
+    }
 
     std::atomic_thread_fence(std::memory_order_acquire);
 
@@ -322,11 +348,13 @@ T circular_queue<T, ForEachArg>::pop()
 }
 
 #if defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
-template< typename T, typename ForEachArg >
-size_t circular_queue<T, ForEachArg>::pop_n(T* buffer, size_t size) {
-    size_t avail = size = min(size, available());
-    if (!avail) return 0;
+template< typename T, typename ForEachArg, bool Padded >
+size_t circular_queue<T, ForEachArg, Padded>::pop_n(T* buffer, size_t size) {
     const auto outPos = m_outPos.load(std::memory_order_acquire);
+    m_cachedInPos = m_inPos.load(std::memory_order_relaxed);
+    const size_t available = m_cachedInPos >= outPos ? m_cachedInPos - outPos : m_bufSize - outPos + m_cachedInPos;
+    size_t avail = size = min(size, available);
+    if (!avail) return 0;
     size_t n = min(avail, static_cast<size_t>(m_bufSize - outPos));
 
     std::atomic_thread_fence(std::memory_order_acquire);
@@ -344,15 +372,16 @@ size_t circular_queue<T, ForEachArg>::pop_n(T* buffer, size_t size) {
 }
 #endif
 
-template< typename T, typename ForEachArg >
+template< typename T, typename ForEachArg, bool Padded >
 #if defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
-void circular_queue<T, ForEachArg>::for_each(const Delegate<void(T&&), ForEachArg>& fun)
+void circular_queue<T, ForEachArg, Padded>::for_each(const Delegate<void(T&&), ForEachArg>& fun)
 #else
-void circular_queue<T, ForEachArg>::for_each(Delegate<void(T&&), ForEachArg> fun)
+void circular_queue<T, ForEachArg, Padded>::for_each(Delegate<void(T&&), ForEachArg> fun)
 #endif
 {
     auto outPos = m_outPos.load(std::memory_order_acquire);
     const auto inPos = m_inPos.load(std::memory_order_relaxed);
+    m_cachedInPos = inPos;
     std::atomic_thread_fence(std::memory_order_acquire);
     while (outPos != inPos)
     {
@@ -363,30 +392,31 @@ void circular_queue<T, ForEachArg>::for_each(Delegate<void(T&&), ForEachArg> fun
     }
 }
 
-template< typename T, typename ForEachArg >
+template< typename T, typename ForEachArg, bool Padded >
 #if defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
-bool circular_queue<T, ForEachArg>::for_each_rev_requeue(const Delegate<bool(T&), ForEachArg>& fun)
+bool circular_queue<T, ForEachArg, Padded>::for_each_rev_requeue(const Delegate<bool(T&), ForEachArg>& fun)
 #else
-bool circular_queue<T, ForEachArg>::for_each_rev_requeue(Delegate<bool(T&), ForEachArg> fun)
+bool circular_queue<T, ForEachArg, Padded>::for_each_rev_requeue(Delegate<bool(T&), ForEachArg> fun)
 #endif
 {
-    auto inPos0 = circular_queue<T, ForEachArg>::m_inPos.load(std::memory_order_acquire);
-    auto outPos = circular_queue<T, ForEachArg>::m_outPos.load(std::memory_order_relaxed);
+    auto inPos0 = m_inPos.load(std::memory_order_acquire);
+    auto outPos = m_outPos.load(std::memory_order_relaxed);
+    m_cachedInPos = inPos0;
     std::atomic_thread_fence(std::memory_order_acquire);
     if (outPos == inPos0) return false;
     auto pos = inPos0;
     auto outPos1 = inPos0;
-    const auto posDecr = circular_queue<T, ForEachArg>::m_bufSize - 1;
+    const auto posDecr = m_bufSize - 1;
     do {
-        pos = (pos + posDecr) % circular_queue<T, ForEachArg>::m_bufSize;
-        T&& val = std::move(circular_queue<T, ForEachArg>::m_buffer[pos]);
+        pos = (pos + posDecr) % m_bufSize;
+        T&& val = std::move(m_buffer[pos]);
         if (fun(val))
         {
-            outPos1 = (outPos1 + posDecr) % circular_queue<T, ForEachArg>::m_bufSize;
-            if (outPos1 != pos) circular_queue<T, ForEachArg>::m_buffer[outPos1] = std::move(val);
+            outPos1 = (outPos1 + posDecr) % m_bufSize;
+            if (outPos1 != pos) m_buffer[outPos1] = std::move(val);
         }
     } while (pos != outPos);
-    circular_queue<T, ForEachArg>::m_outPos.store(outPos1, std::memory_order_release);
+    m_outPos.store(outPos1, std::memory_order_release);
     return true;
 }
 
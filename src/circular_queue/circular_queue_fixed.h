@@ -0,0 +1,328 @@
+/*
+circular_queue_fixed.h - Implementation of a lock-free circular queue of fixed capacity.
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __circular_queue_fixed_h
+#define __circular_queue_fixed_h
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#if defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include "Delegate.h"
+
+#if !defined(ESP32) && !defined(ESP8266)
+#define IRAM_ATTR
+#endif
+
+/*!
+    @brief	Instance class for a single-producer, single-consumer circular queue / ring buffer (FIFO)
+            of a capacity that is fixed at compile time.
+            Like circular_queue, this implementation is lock-free between producer and consumer for the
+            available(), peek(), pop(), and push() type functions.
+            The elements are stored inline, such that constructing the queue does not allocate.
+            Capacity must be a power of two. The indices run freely and are masked to the buffer,
+            instead of wrapping around by modulo division, and all Capacity elements are usable.
+            With Padded = true, the indices of producer and consumer are on separate cache lines.
+*/
+template< typename T, size_t Capacity, typename ForEachArg = void, bool Padded = false >
+class circular_queue_fixed
+{
+    static_assert(Capacity && !(Capacity & (Capacity - 1)), "circular_queue_fixed capacity must be a power of two");
+
+public:
+    circular_queue_fixed() : m_cachedOutPos(0), m_cachedInPos(0), m_buffer()
+    {
+        m_inPos.store(0);
+        m_outPos.store(0);
+    }
+    circular_queue_fixed(const circular_queue_fixed&) = delete;
+    circular_queue_fixed& operator=(const circular_queue_fixed&) = delete;
+
+    /*!
+        @brief	Get the numer of elements the queue can hold at most.
+    */
+    static constexpr size_t capacity()
+    {
+        return Capacity;
+    }
+
+    /*!
+        @brief	Discard all data in the queue.
+    */
+    void flush()
+    {
+        m_cachedInPos = m_inPos.load();
+        m_outPos.store(m_cachedInPos);
+    }
+
+    /*!
+        @brief	Get a snapshot number of elements that can be retrieved by pop.
+    */
+    size_t available() const
+    {
+        return m_inPos.load() - m_outPos.load();
+    }
+
+    /*!
+        @brief	Get the remaining free elementes for pushing.
+    */
+    size_t available_for_push() const
+    {
+        return Capacity - (m_inPos.load() - m_outPos.load());
+    }
+
+    /*!
+        @brief	Peek at the next element pop will return without removing it from the queue.
+        @return An rvalue copy of the next element that can be popped. If the queue is empty,
+                return an rvalue copy of the element that is pending the next push.
+    */
+    T peek() const
+    {
+        const auto outPos = m_outPos.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return m_buffer[outPos & MASK];
+    }
+
+    /*!
+        @brief	Peek at the next pending input value.
+        @return A reference to the next element that can be pushed.
+    */
+    inline T& IRAM_ATTR pushpeek() __attribute__((always_inline))
+    {
+        const auto inPos = m_inPos.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return m_buffer[inPos & MASK];
+    }
+
+    /*!
+        @brief	Release the next pending input value, accessible by pushpeek(), into the queue.
+        @return true if the queue accepted the value, false if the queue
+                was full.
+    */
+    inline bool IRAM_ATTR push() __attribute__((always_inline))
+    {
+        const auto inPos = m_inPos.load(std::memory_order_acquire);
+        if (!reserve(inPos)) return false;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        m_inPos.store(inPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+        @brief	Move the rvalue parameter into the queue.
+        @return true if the queue accepted the value, false if the queue
+                was full.
+    */
+    inline bool IRAM_ATTR push(T&& val) __attribute__((always_inline))
+    {
+        const auto inPos = m_inPos.load(std::memory_order_acquire);
+        if (!reserve(inPos)) return false;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        m_buffer[inPos & MASK] = std::move(val);
+
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_inPos.store(inPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+        @brief	Push a copy of the parameter into the queue.
+        @return true if the queue accepted the value, false if the queue
+                was full.
+    */
+    inline bool IRAM_ATTR push(const T& val) __attribute__((always_inline))
+    {
+        T v(val);
+        return push(std::move(v));
+    }
+
+    /*!
+        @brief	Push copies of multiple elements from a buffer into the queue,
+                in order, beginning at buffer's head.
+        @return The number of elements actually copied into the queue, counted
+                from the buffer head.
+    */
+    size_t push_n(const T* buffer, size_t size);
+
+    /*!
+        @brief	Pop the next available element from the queue.
+        @return An rvalue copy of the popped element, or a default
+                value of type T if the queue is empty.
+    */
+    T pop();
+
+    /*!
+        @brief	Pop multiple elements in ordered sequence from the queue to a buffer.
+                If buffer is nullptr, simply discards up to size elements from the queue.
+        @return The number of elements actually popped from the queue to
+                buffer.
+    */
+    size_t pop_n(T* buffer, size_t size);
+
+    /*!
+        @brief	Iterate over and remove each available element from queue,
+                calling back fun with an rvalue reference of every single element.
+    */
+    void for_each(const Delegate<void(T&&), ForEachArg>& fun);
+
+    /*!
+        @brief	In reverse order, iterate over, pop and optionally requeue each available element from the queue,
+                calling back fun with a reference of every single element.
+                Requeuing is dependent on the return boolean of the callback function. If it
+                returns true, the requeue occurs.
+    */
+    bool for_each_rev_requeue(const Delegate<bool(T&), ForEachArg>& fun);
+
+protected:
+    static constexpr size_t MASK = Capacity - 1;
+    static constexpr size_t CACHELINESIZE = 64;
+    static constexpr size_t INDEXALIGNMENT = Padded ? CACHELINESIZE : alignof(std::atomic<size_t>);
+
+    // check that there is room for pushing at inPos, reloading m_outPos only if the
+    // copy from the last load shows the queue full
+    inline bool IRAM_ATTR reserve(size_t inPos) __attribute__((always_inline))
+    {
+        if (inPos - m_cachedOutPos < Capacity) return true;
+        m_cachedOutPos = m_outPos.load(std::memory_order_relaxed);
+        return inPos - m_cachedOutPos < Capacity;
+    }
+
+    const T defaultValue = {};
+    // written by the producer
+    alignas(INDEXALIGNMENT) std::atomic<size_t> m_inPos;
+    size_t m_cachedOutPos;
+    // written by the consumer
+    alignas(INDEXALIGNMENT) std::atomic<size_t> m_outPos;
+    size_t m_cachedInPos;
+    alignas(INDEXALIGNMENT) alignas(std::array<T, Capacity>) std::array<T, Capacity> m_buffer;
+};
+
+template< typename T, size_t Capacity, typename ForEachArg, bool Padded >
+size_t circular_queue_fixed<T, Capacity, ForEachArg, Padded>::push_n(const T* buffer, size_t size)
+{
+    const auto inPos = m_inPos.load(std::memory_order_acquire);
+    m_cachedOutPos = m_outPos.load(std::memory_order_relaxed);
+    size = std::min(size, Capacity - (inPos - m_cachedOutPos));
+    if (!size) return 0;
+    const size_t blockSize = std::min(size, Capacity - (inPos & MASK));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    std::copy_n(std::make_move_iterator(buffer), blockSize, m_buffer.begin() + (inPos & MASK));
+    std::copy_n(std::make_move_iterator(buffer + blockSize), size - blockSize, m_buffer.begin());
+
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_inPos.store(inPos + size, std::memory_order_release);
+    return size;
+}
+
+template< typename T, size_t Capacity, typename ForEachArg, bool Padded >
+T circular_queue_fixed<T, Capacity, ForEachArg, Padded>::pop()
+{
+    const auto outPos = m_outPos.load(std::memory_order_acquire);
+    if (m_cachedInPos == outPos)
+    {
+        m_cachedInPos = m_inPos.load(std::memory_order_relaxed);
+        if (m_cachedInPos == outPos) return defaultValue;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    auto val = std::move(m_buffer[outPos & MASK]);
+
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_outPos.store(outPos + 1, std::memory_order_release);
+    return val;
+}
+
+template< typename T, size_t Capacity, typename ForEachArg, bool Padded >
+size_t circular_queue_fixed<T, Capacity, ForEachArg, Padded>::pop_n(T* buffer, size_t size)
+{
+    const auto outPos = m_outPos.load(std::memory_order_acquire);
+    m_cachedInPos = m_inPos.load(std::memory_order_relaxed);
+    size = std::min(size, m_cachedInPos - outPos);
+    if (!size) return 0;
+    const size_t blockSize = std::min(size, Capacity - (outPos & MASK));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (buffer)
+    {
+        std::copy_n(std::make_move_iterator(m_buffer.begin() + (outPos & MASK)), blockSize, buffer);
+        std::copy_n(std::make_move_iterator(m_buffer.begin()), size - blockSize, buffer + blockSize);
+    }
+
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_outPos.store(outPos + size, std::memory_order_release);
+    return size;
+}
+
+template< typename T, size_t Capacity, typename ForEachArg, bool Padded >
+void circular_queue_fixed<T, Capacity, ForEachArg, Padded>::for_each(const Delegate<void(T&&), ForEachArg>& fun)
+{
+    auto outPos = m_outPos.load(std::memory_order_acquire);
+    const auto inPos = m_inPos.load(std::memory_order_relaxed);
+    m_cachedInPos = inPos;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    while (outPos != inPos)
+    {
+        fun(std::move(m_buffer[outPos & MASK]));
+        std::atomic_thread_fence(std::memory_order_release);
+        m_outPos.store(++outPos, std::memory_order_release);
+    }
+}
+
+template< typename T, size_t Capacity, typename ForEachArg, bool Padded >
+bool circular_queue_fixed<T, Capacity, ForEachArg, Padded>::for_each_rev_requeue(const Delegate<bool(T&), ForEachArg>& fun)
+{
+    auto inPos0 = m_inPos.load(std::memory_order_acquire);
+    auto outPos = m_outPos.load(std::memory_order_relaxed);
+    m_cachedInPos = inPos0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (outPos == inPos0) return false;
+    auto pos = inPos0;
+    auto outPos1 = inPos0;
+    do {
+        --pos;
+        T&& val = std::move(m_buffer[pos & MASK]);
+        if (fun(val))
+        {
+            --outPos1;
+            if (outPos1 != pos) m_buffer[outPos1 & MASK] = std::move(val);
+        }
+    } while (pos != outPos);
+    m_outPos.store(outPos1, std::memory_order_release);
+    return true;
+}
+
+#endif // defined(ESP8266) || defined(ESP32) || !defined(ARDUINO)
+
+#endif // __circular_queue_fixed_h
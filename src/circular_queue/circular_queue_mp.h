@@ -158,6 +158,8 @@ T& circular_queue_mp<T, ForEachArg>::pop_requeue()
     if (inPos == outPos) return circular_queue<T, ForEachArg>::defaultValue;
     T& val = circular_queue<T, ForEachArg>::m_buffer[inPos] = std::move(circular_queue<T, ForEachArg>::m_buffer[outPos]);
     const auto bufSize = circular_queue<T, ForEachArg>::m_bufSize;
+    circular_queue<T, ForEachArg>::m_cachedOutPos = (outPos + 1) % bufSize;
+    circular_queue<T, ForEachArg>::m_cachedInPos = (inPos + 1) % bufSize;
     std::atomic_thread_fence(std::memory_order_release);
 	circular_queue<T, ForEachArg>::m_outPos.store((outPos + 1) % bufSize, std::memory_order_relaxed);
 	circular_queue<T, ForEachArg>::m_inPos.store((inPos + 1) % bufSize, std::memory_order_release);
@@ -169,10 +171,12 @@ bool circular_queue_mp<T, ForEachArg>::for_each_requeue(const Delegate<bool(T&),
 {
     auto inPos0 = circular_queue<T, ForEachArg>::m_inPos.load(std::memory_order_acquire);
     auto outPos = circular_queue<T, ForEachArg>::m_outPos.load(std::memory_order_relaxed);
+    circular_queue<T, ForEachArg>::m_cachedInPos = inPos0;
     std::atomic_thread_fence(std::memory_order_acquire);
     if (outPos == inPos0) return false;
     do {
         T&& val = std::move(circular_queue<T, ForEachArg>::m_buffer[outPos]);
+        const auto nextOutPos = (outPos + 1) % circular_queue<T, ForEachArg>::m_bufSize;
         if (fun(val))
         {
 #ifdef ESP8266
@@ -185,14 +189,17 @@ bool circular_queue_mp<T, ForEachArg>::for_each_requeue(const Delegate<bool(T&),
             std::atomic_thread_fence(std::memory_order_acquire);
 			circular_queue<T, ForEachArg>::m_buffer[inPos] = std::move(val);
             std::atomic_thread_fence(std::memory_order_release);
+            // advance m_outPos past the requeued element before m_inPos, and reload the producers' copy of it
+            circular_queue<T, ForEachArg>::m_outPos.store(nextOutPos, std::memory_order_release);
+            circular_queue<T, ForEachArg>::m_cachedOutPos = circular_queue<T, ForEachArg>::m_outPos.load(std::memory_order_relaxed);
 			circular_queue<T, ForEachArg>::m_inPos.store((inPos + 1) % circular_queue<T, ForEachArg>::m_bufSize, std::memory_order_release);
         }
         else
         {
             std::atomic_thread_fence(std::memory_order_release);
+            circular_queue<T, ForEachArg>::m_outPos.store(nextOutPos, std::memory_order_release);
         }
-        outPos = (outPos + 1) % circular_queue<T, ForEachArg>::m_bufSize;
-		circular_queue<T, ForEachArg>::m_outPos.store(outPos, std::memory_order_release);
+        outPos = nextOutPos;
     } while (outPos != inPos0);
     return true;
 }
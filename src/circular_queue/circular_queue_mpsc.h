@@ -0,0 +1,354 @@
+/*
+circular_queue_mpsc.h - Implementation of a lock-free multi-producer circular queue.
+Copyright (c) 2019 Dirk O. Kaar. All rights reserved.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef __circular_queue_mpsc_h
+#define __circular_queue_mpsc_h
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#if defined(ESP32) || !defined(ARDUINO)
+#include <atomic>
+#include <memory>
+#include "Delegate.h"
+
+#if !defined(ESP32) && !defined(ESP8266)
+#define IRAM_ATTR
+#endif
+
+/*!
+    @brief	Instance class for a multi-producer, single-consumer circular queue / ring buffer (FIFO).
+            Unlike circular_queue_mp, this implementation is lock-free for concurrent producers, too.
+            Each element slot carries a sequence number, that tells producers whether the slot is free,
+            and the consumer whether it is filled, such that producers only contend on claiming
+            positions, by compare-and-swap.
+            The capacity is rounded up to the next power of two.
+*/
+template< typename T, typename ForEachArg = void >
+class circular_queue_mpsc
+{
+public:
+    /*!
+        @brief	Constructs a valid, but zero-capacity dummy queue.
+    */
+    circular_queue_mpsc() : m_bufSize(0), m_mask(0)
+    {
+        m_inPos.store(0);
+        m_outPos.store(0);
+    }
+    /*!
+        @brief  Constructs a queue of at least the given capacity.
+    */
+    circular_queue_mpsc(const size_t capacity) : m_bufSize(roundCapacity(capacity)), m_mask(m_bufSize - 1),
+        m_buffer(new Slot[m_bufSize])
+    {
+        for (size_t i = 0; i < m_bufSize; ++i) m_buffer[i].seq.store(i, std::memory_order_relaxed);
+        m_inPos.store(0);
+        m_outPos.store(0);
+    }
+    circular_queue_mpsc(const circular_queue_mpsc&) = delete;
+    circular_queue_mpsc& operator=(const circular_queue_mpsc&) = delete;
+
+    /*!
+        @brief	Get the numer of elements the queue can hold at most.
+    */
+    size_t capacity() const
+    {
+        return m_bufSize;
+    }
+
+    /*!
+        @brief	Get a snapshot number of elements that can be retrieved by pop.
+                This includes elements that producers are still in the middle of pushing.
+    */
+    size_t available() const
+    {
+        return m_inPos.load() - m_outPos.load();
+    }
+
+    /*!
+        @brief	Get a snapshot number of the remaining free elements for pushing.
+    */
+    size_t available_for_push() const
+    {
+        return m_bufSize - available();
+    }
+
+    /*!
+        @brief	Move the rvalue parameter into the queue. Safe for multiple
+                concurrent producers, lock-free.
+        @return true if the queue accepted the value, false if the queue
+                was full.
+    */
+    bool IRAM_ATTR push(T&& val)
+    {
+        size_t inPos;
+        if (!claim(inPos, 1)) return false;
+        Slot& slot = m_buffer[inPos & m_mask];
+        slot.value = std::move(val);
+        slot.seq.store(inPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+        @brief	Push a copy of the parameter into the queue. Safe for multiple
+                concurrent producers, lock-free.
+        @return true if the queue accepted the value, false if the queue
+                was full.
+    */
+    bool IRAM_ATTR push(const T& val)
+    {
+        T v(val);
+        return push(std::move(v));
+    }
+
+    /*!
+        @brief	Push copies of multiple elements from a buffer into the queue,
+                in order, beginning at buffer's head. Safe for multiple concurrent
+                producers, lock-free. The pushed elements are contiguous in the queue.
+        @return The number of elements actually copied into the queue, counted
+                from the buffer head.
+    */
+    size_t push_n(const T* buffer, size_t size);
+
+    /*!
+        @brief	Pop the next available element from the queue. Only for the single consumer.
+        @return An rvalue copy of the popped element, or a default
+                value of type T if the queue is empty.
+    */
+    T pop();
+
+    /*!
+        @brief	Pop multiple elements in ordered sequence from the queue to a buffer.
+                If buffer is nullptr, simply discards up to size elements from the queue.
+                Only for the single consumer.
+        @return The number of elements actually popped from the queue to
+                buffer.
+    */
+    size_t pop_n(T* buffer, size_t size);
+
+    /*!
+        @brief	Pops the next available element from the queue, requeues
+                it immediately. Only for the single consumer, lock-free.
+        @return A reference to the just requeued element, or the default
+                value of type T if the queue is empty.
+    */
+    T& pop_requeue();
+
+    /*!
+        @brief	Iterate over and remove each available element from queue,
+                calling back fun with an rvalue reference of every single element.
+                Only for the single consumer.
+    */
+    void for_each(const Delegate<void(T&&), ForEachArg>& fun);
+
+    /*!
+        @brief	Iterate over, pop and optionally requeue each available element from the queue,
+                calling back fun with a reference of every single element.
+                Requeuing is dependent on the return boolean of the callback function. If it
+                returns true, the requeue occurs. Only for the single consumer.
+    */
+    bool for_each_requeue(const Delegate<bool(T&), ForEachArg>& fun);
+
+protected:
+    struct Slot
+    {
+        // equals the position that may push into the slot while it is free,
+        // and that position + 1 once it is filled
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    static size_t roundCapacity(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        return size;
+    }
+
+    /*!
+        @brief	Claim up to count consecutive positions for pushing.
+        @return The number of claimed positions beginning at inPos, 0 if the queue is full.
+    */
+    size_t IRAM_ATTR claim(size_t& inPos, size_t count);
+
+    /*!
+        @brief	Requeue the element at outPos, the next one to pop, and pop it.
+        @return The slot that the element is requeued into.
+    */
+    Slot& requeue(size_t outPos);
+
+    T defaultValue = {};
+    size_t m_bufSize;
+    size_t m_mask;
+    std::unique_ptr<Slot[]> m_buffer;
+    std::atomic<size_t> m_inPos;
+    // only stored by the consumer, producers read it to count the free slots
+    std::atomic<size_t> m_outPos;
+};
+
+template< typename T, typename ForEachArg >
+size_t IRAM_ATTR circular_queue_mpsc<T, ForEachArg>::claim(size_t& inPos, size_t count)
+{
+    inPos = m_inPos.load(std::memory_order_relaxed);
+    if (!count || !m_bufSize) return 0;
+    for (;;)
+    {
+        // slots get freed in order, if the slot of the last position is free, all others are
+        const size_t free = m_bufSize - (inPos - m_outPos.load(std::memory_order_acquire));
+        size_t claimed = count < free ? count : free;
+        if (!claimed || m_buffer[(inPos + claimed - 1) & m_mask].seq.load(std::memory_order_acquire) != inPos + claimed - 1)
+        {
+            // either full, or inPos is outdated
+            const auto current = m_inPos.load(std::memory_order_relaxed);
+            if (current == inPos && m_buffer[inPos & m_mask].seq.load(std::memory_order_acquire) != inPos) return 0;
+            inPos = current;
+            continue;
+        }
+        if (m_inPos.compare_exchange_weak(inPos, inPos + claimed, std::memory_order_relaxed)) return claimed;
+    }
+}
+
+template< typename T, typename ForEachArg >
+size_t circular_queue_mpsc<T, ForEachArg>::push_n(const T* buffer, size_t size)
+{
+    size_t inPos;
+    const size_t claimed = claim(inPos, size);
+    for (size_t i = 0; i < claimed; ++i)
+    {
+        Slot& slot = m_buffer[(inPos + i) & m_mask];
+        slot.value = buffer[i];
+        slot.seq.store(inPos + i + 1, std::memory_order_release);
+    }
+    return claimed;
+}
+
+template< typename T, typename ForEachArg >
+T circular_queue_mpsc<T, ForEachArg>::pop()
+{
+    if (!m_bufSize) return defaultValue;
+    const auto outPos = m_outPos.load(std::memory_order_relaxed);
+    Slot& slot = m_buffer[outPos & m_mask];
+    if (slot.seq.load(std::memory_order_acquire) != outPos + 1) return defaultValue;
+    auto val = std::move(slot.value);
+    slot.seq.store(outPos + m_bufSize, std::memory_order_release);
+    m_outPos.store(outPos + 1, std::memory_order_release);
+    return val;
+}
+
+template< typename T, typename ForEachArg >
+size_t circular_queue_mpsc<T, ForEachArg>::pop_n(T* buffer, size_t size)
+{
+    if (!m_bufSize) return 0;
+    auto outPos = m_outPos.load(std::memory_order_relaxed);
+    size_t popped = 0;
+    for (; popped < size; ++popped, ++outPos)
+    {
+        Slot& slot = m_buffer[outPos & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != outPos + 1) break;
+        if (buffer) *buffer++ = std::move(slot.value);
+        slot.seq.store(outPos + m_bufSize, std::memory_order_release);
+    }
+    m_outPos.store(outPos, std::memory_order_release);
+    return popped;
+}
+
+template< typename T, typename ForEachArg >
+typename circular_queue_mpsc<T, ForEachArg>::Slot& circular_queue_mpsc<T, ForEachArg>::requeue(size_t outPos)
+{
+    Slot& head = m_buffer[outPos & m_mask];
+    auto inPos = m_inPos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        if (inPos == outPos + m_bufSize)
+        {
+            // full, the position to push into is that of the element itself, producers find it taken
+            if (!m_inPos.compare_exchange_weak(inPos, inPos + 1, std::memory_order_relaxed)) continue;
+            head.seq.store(inPos + 1, std::memory_order_release);
+            m_outPos.store(outPos + 1, std::memory_order_release);
+            return head;
+        }
+        Slot& slot = m_buffer[inPos & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != inPos)
+        {
+            inPos = m_inPos.load(std::memory_order_relaxed);
+            continue;
+        }
+        if (!m_inPos.compare_exchange_weak(inPos, inPos + 1, std::memory_order_relaxed)) continue;
+        slot.value = std::move(head.value);
+        head.seq.store(outPos + m_bufSize, std::memory_order_release);
+        m_outPos.store(outPos + 1, std::memory_order_release);
+        slot.seq.store(inPos + 1, std::memory_order_release);
+        return slot;
+    }
+}
+
+template< typename T, typename ForEachArg >
+T& circular_queue_mpsc<T, ForEachArg>::pop_requeue()
+{
+    if (!m_bufSize) return defaultValue;
+    const auto outPos = m_outPos.load(std::memory_order_relaxed);
+    if (m_buffer[outPos & m_mask].seq.load(std::memory_order_acquire) != outPos + 1) return defaultValue;
+    return requeue(outPos).value;
+}
+
+template< typename T, typename ForEachArg >
+void circular_queue_mpsc<T, ForEachArg>::for_each(const Delegate<void(T&&), ForEachArg>& fun)
+{
+    if (!m_bufSize) return;
+    auto outPos = m_outPos.load(std::memory_order_relaxed);
+    const auto inPos = m_inPos.load(std::memory_order_acquire);
+    for (; outPos != inPos; ++outPos)
+    {
+        Slot& slot = m_buffer[outPos & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != outPos + 1) break;
+        fun(std::move(slot.value));
+        slot.seq.store(outPos + m_bufSize, std::memory_order_release);
+        m_outPos.store(outPos + 1, std::memory_order_release);
+    }
+}
+
+template< typename T, typename ForEachArg >
+bool circular_queue_mpsc<T, ForEachArg>::for_each_requeue(const Delegate<bool(T&), ForEachArg>& fun)
+{
+    if (!m_bufSize) return false;
+    auto outPos = m_outPos.load(std::memory_order_relaxed);
+    const auto inPos0 = m_inPos.load(std::memory_order_acquire);
+    if (outPos == inPos0) return false;
+    for (; outPos != inPos0; ++outPos)
+    {
+        Slot& slot = m_buffer[outPos & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != outPos + 1) break;
+        if (fun(slot.value))
+        {
+            requeue(outPos);
+        }
+        else
+        {
+            slot.seq.store(outPos + m_bufSize, std::memory_order_release);
+            m_outPos.store(outPos + 1, std::memory_order_release);
+        }
+    }
+    return true;
+}
+
+#endif // defined(ESP32) || !defined(ARDUINO)
+
+#endif // __circular_queue_mpsc_h